@@ -1,2 +1,4 @@
 PLUGIN_NAME = nw-clef
 -include $(ROOTPATH)libclef/config.mak
+LDFLAGS_R += -pthread
+LDFLAGS_D += -pthread
@@ -0,0 +1,469 @@
+// A CLAP instrument that plays the programs of an RBNK bank live, from note
+// input. This is separate from the player plugin in clefplugin.cpp, which
+// plays whole sequences out of an archive.
+//
+// The bank is named by a string in the form "archive.brsar?BANK_NAME" (or
+// "?number", counting banks from 1). It is saved with the host's project, and
+// a new instance takes it from the NW_CLEF_BANK environment variable.
+//
+// Everything that parses, decodes or allocates happens in activate(). The
+// waves of the whole bank are decoded there and the voices are allocated up
+// front, so process() only renders. Notes start at the exact frame the host
+// gives them, inside the same buffer, so the plugin adds no latency of its
+// own.
+
+#include "archivecache.h"
+#include "bankcache.h"
+#include "nwplayer.h"
+#include "rvl/rsarfile.h"
+#include "rvl/rbnkfile.h"
+#include "rvl/rwarfile.h"
+#include "rvl/infochunk.h"
+#include <clap/clap.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// MIDI pitch bend covers +/- 2 semitones unless told otherwise.
+constexpr double BEND_RANGE = 2.0;
+
+const char* const features[] = {
+  CLAP_PLUGIN_FEATURE_INSTRUMENT,
+  CLAP_PLUGIN_FEATURE_SAMPLER,
+  CLAP_PLUGIN_FEATURE_STEREO,
+  nullptr,
+};
+
+const clap_plugin_descriptor_t descriptor = {
+  CLAP_VERSION_INIT,
+  "com.github.ahigerd.nw-clef.instrument",
+  "nw-clef Instrument",
+  "Adam Higerd",
+  "https://github.com/ahigerd/nw-clef",
+  "",
+  "",
+  "0.0.1",
+  "Plays RBNK instrument banks from BRSAR archives",
+  features,
+};
+
+struct NWClapInstrument
+{
+  NWClapInstrument(const clap_host_t* host);
+
+  bool activate(double sampleRate, std::uint32_t maxFrames);
+  void deactivate();
+  void releaseBank();
+  void process(const clap_process_t* process);
+  void handleEvent(const clap_event_header_t* header);
+  void handleMidi(const std::uint8_t* data);
+  void render(const clap_process_t* process, std::uint32_t start, std::uint32_t end);
+
+  clap_plugin_t plugin;
+  const clap_host_t* host;
+  std::string bankSpec;
+  bool active;
+
+  std::shared_ptr<ArchiveCache::Archive> archive;
+  std::shared_ptr<BankCache::Bank> bank;
+  std::unique_ptr<NWPlayer> player;
+  SampleCache* sampleCache;
+  std::uint64_t cacheToken;
+  std::vector<float> scratch;
+};
+
+NWClapInstrument::NWClapInstrument(const clap_host_t* host)
+: host(host), active(false), sampleCache(nullptr), cacheToken(0)
+{
+  const char* spec = std::getenv("NW_CLEF_BANK");
+  if (spec) {
+    bankSpec = spec;
+  }
+}
+
+bool NWClapInstrument::activate(double sampleRate, std::uint32_t maxFrames)
+{
+  scratch.assign(std::size_t(maxFrames) * 2, 0.0f);
+  active = true;
+  if (bankSpec.empty()) {
+    std::cerr << "nw-clef: no bank selected; set NW_CLEF_BANK to archive.brsar?BANK_NAME" << std::endl;
+    return true;
+  }
+
+  // A bank that can't be loaded leaves the instrument silent instead of
+  // failing the host's project.
+  try {
+    std::string bankName;
+    std::string path = ArchiveCache::splitSubsong(bankSpec, bankName);
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("unable to open file");
+    }
+    archive = ArchiveCache::instance()->open(path, file);
+
+    const auto& banks = archive->file->info->soundBankEntries;
+    int bankIndex = -1;
+    for (int i = 0; i < banks.size(); i++) {
+      if (banks[i].name == bankName) {
+        bankIndex = i;
+        break;
+      }
+    }
+    if (bankIndex < 0 && !bankName.empty() && bankName.find_first_not_of("0123456789") == std::string::npos) {
+      bankIndex = std::stoi(bankName) - 1;
+    }
+    if (bankIndex < 0 || bankIndex >= banks.size()) {
+      throw std::runtime_error("no bank \"" + bankName + "\" in archive");
+    }
+    bank = archive->banks->get(bankIndex);
+
+    sampleCache = ArchiveCache::instance()->sampleCache();
+    cacheToken = sampleCache->beginSequence();
+    player.reset(new NWPlayer(sampleRate));
+    if (!player->prepareBank(bank->rbnk.get(), bank->rwar.get())) {
+      throw std::runtime_error("bank has no playable waves");
+    }
+  } catch (std::exception& e) {
+    std::cerr << "nw-clef: " << bankSpec << ": " << e.what() << std::endl;
+    releaseBank();
+  }
+  return true;
+}
+
+void NWClapInstrument::deactivate()
+{
+  releaseBank();
+  active = false;
+}
+
+void NWClapInstrument::releaseBank()
+{
+  player.reset();
+  bank.reset();
+  if (sampleCache) {
+    sampleCache->endSequence(cacheToken);
+    sampleCache = nullptr;
+  }
+  archive.reset();
+}
+
+void NWClapInstrument::process(const clap_process_t* process)
+{
+  // Render up to each event, then apply it, so that every note starts on the
+  // frame the host asked for.
+  std::uint32_t done = 0;
+  std::uint32_t numEvents = process->in_events->size(process->in_events);
+  for (std::uint32_t i = 0; i < numEvents; i++) {
+    const clap_event_header_t* header = process->in_events->get(process->in_events, i);
+    std::uint32_t at = std::min(header->time, process->frames_count);
+    if (at > done) {
+      render(process, done, at);
+      done = at;
+    }
+    handleEvent(header);
+  }
+  render(process, done, process->frames_count);
+}
+
+void NWClapInstrument::handleEvent(const clap_event_header_t* header)
+{
+  if (!player || header->space_id != CLAP_CORE_EVENT_SPACE_ID) {
+    return;
+  }
+  switch (header->type) {
+  case CLAP_EVENT_NOTE_ON: {
+    auto event = reinterpret_cast<const clap_event_note_t*>(header);
+    int velocity = std::max(1, int(std::lround(event->velocity * 127)));
+    player->noteOn(std::max<int>(event->channel, 0), event->key, std::min(velocity, 127));
+    break;
+  }
+  case CLAP_EVENT_NOTE_OFF:
+  case CLAP_EVENT_NOTE_CHOKE: {
+    auto event = reinterpret_cast<const clap_event_note_t*>(header);
+    if (event->key < 0) {
+      player->allNotesOff();
+    } else {
+      player->noteOff(std::max<int>(event->channel, 0), event->key);
+    }
+    break;
+  }
+  case CLAP_EVENT_MIDI:
+    handleMidi(reinterpret_cast<const clap_event_midi_t*>(header)->data);
+    break;
+  }
+}
+
+void NWClapInstrument::handleMidi(const std::uint8_t* data)
+{
+  int channel = data[0] & 0x0F;
+  switch (data[0] & 0xF0) {
+  case 0x80:
+    player->noteOff(channel, data[1]);
+    break;
+  case 0x90:
+    player->noteOn(channel, data[1], data[2]);
+    break;
+  case 0xB0:
+    if (data[1] == 7) {
+      player->setChannelVolume(channel, data[2] / 127.0);
+    } else if (data[1] == 10) {
+      player->setChannelPan(channel, data[2] / 128.0);
+    } else if (data[1] == 120 || data[1] == 123) {
+      player->allNotesOff();
+    }
+    break;
+  case 0xC0:
+    player->setProgram(channel, data[1]);
+    break;
+  case 0xE0: {
+    int bend = (data[1] | (data[2] << 7)) - 8192;
+    player->setPitchBend(channel, bend / 8192.0 * BEND_RANGE);
+    break;
+  }
+  }
+}
+
+void NWClapInstrument::render(const clap_process_t* process, std::uint32_t start, std::uint32_t end)
+{
+  if (start >= end || !process->audio_outputs_count) {
+    return;
+  }
+  const clap_audio_buffer_t& output = process->audio_outputs[0];
+  std::uint32_t frames = end - start;
+  if (player) {
+    player->render(scratch.data(), frames);
+  } else {
+    std::fill(scratch.begin(), scratch.begin() + frames * 2, 0.0f);
+  }
+  for (std::uint32_t c = 0; c < output.channel_count; c++) {
+    float* out = output.data32[c] + start;
+    const float* in = scratch.data() + (c & 1);
+    for (std::uint32_t i = 0; i < frames; i++) {
+      out[i] = in[i * 2];
+    }
+  }
+}
+
+NWClapInstrument* self(const clap_plugin_t* plugin)
+{
+  return static_cast<NWClapInstrument*>(plugin->plugin_data);
+}
+
+std::uint32_t audioPortsCount(const clap_plugin_t* plugin, bool isInput)
+{
+  return isInput ? 0 : 1;
+}
+
+bool audioPortsGet(const clap_plugin_t* plugin, std::uint32_t index, bool isInput, clap_audio_port_info_t* info)
+{
+  if (isInput || index != 0) {
+    return false;
+  }
+  info->id = 0;
+  std::snprintf(info->name, sizeof(info->name), "%s", "Output");
+  info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+  info->channel_count = 2;
+  info->port_type = CLAP_PORT_STEREO;
+  info->in_place_pair = CLAP_INVALID_ID;
+  return true;
+}
+
+const clap_plugin_audio_ports_t audioPorts = { audioPortsCount, audioPortsGet };
+
+std::uint32_t notePortsCount(const clap_plugin_t* plugin, bool isInput)
+{
+  return isInput ? 1 : 0;
+}
+
+bool notePortsGet(const clap_plugin_t* plugin, std::uint32_t index, bool isInput, clap_note_port_info_t* info)
+{
+  if (!isInput || index != 0) {
+    return false;
+  }
+  info->id = 0;
+  info->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI;
+  info->preferred_dialect = CLAP_NOTE_DIALECT_CLAP;
+  std::snprintf(info->name, sizeof(info->name), "%s", "Notes");
+  return true;
+}
+
+const clap_plugin_note_ports_t notePorts = { notePortsCount, notePortsGet };
+
+std::uint32_t latencyGet(const clap_plugin_t* plugin)
+{
+  return 0;
+}
+
+const clap_plugin_latency_t latency = { latencyGet };
+
+bool stateSave(const clap_plugin_t* plugin, const clap_ostream_t* stream)
+{
+  const std::string& spec = self(plugin)->bankSpec;
+  const char* data = spec.data();
+  std::int64_t remaining = spec.size();
+  while (remaining > 0) {
+    std::int64_t written = stream->write(stream, data, remaining);
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    remaining -= written;
+  }
+  return true;
+}
+
+bool stateLoad(const clap_plugin_t* plugin, const clap_istream_t* stream)
+{
+  NWClapInstrument* inst = self(plugin);
+  std::string spec;
+  char buffer[256];
+  while (true) {
+    std::int64_t bytes = stream->read(stream, buffer, sizeof(buffer));
+    if (bytes < 0) {
+      return false;
+    } else if (bytes == 0) {
+      break;
+    }
+    spec.append(buffer, bytes);
+  }
+  if (spec != inst->bankSpec) {
+    inst->bankSpec = spec;
+    // The bank is only loaded on activation, off the audio thread.
+    if (inst->active) {
+      inst->host->request_restart(inst->host);
+    }
+  }
+  return true;
+}
+
+const clap_plugin_state_t state = { stateSave, stateLoad };
+
+bool pluginInit(const clap_plugin_t* plugin)
+{
+  return true;
+}
+
+void pluginDestroy(const clap_plugin_t* plugin)
+{
+  delete self(plugin);
+}
+
+bool pluginActivate(const clap_plugin_t* plugin, double sampleRate, std::uint32_t minFrames, std::uint32_t maxFrames)
+{
+  return self(plugin)->activate(sampleRate, maxFrames);
+}
+
+void pluginDeactivate(const clap_plugin_t* plugin)
+{
+  self(plugin)->deactivate();
+}
+
+bool pluginStartProcessing(const clap_plugin_t* plugin)
+{
+  return true;
+}
+
+void pluginStopProcessing(const clap_plugin_t* plugin)
+{
+  // nothing to do
+}
+
+void pluginReset(const clap_plugin_t* plugin)
+{
+  if (self(plugin)->player) {
+    self(plugin)->player->allNotesOff();
+  }
+}
+
+clap_process_status pluginProcess(const clap_plugin_t* plugin, const clap_process_t* process)
+{
+  self(plugin)->process(process);
+  return CLAP_PROCESS_CONTINUE;
+}
+
+const void* pluginGetExtension(const clap_plugin_t* plugin, const char* id)
+{
+  if (!std::strcmp(id, CLAP_EXT_AUDIO_PORTS)) {
+    return &audioPorts;
+  } else if (!std::strcmp(id, CLAP_EXT_NOTE_PORTS)) {
+    return &notePorts;
+  } else if (!std::strcmp(id, CLAP_EXT_LATENCY)) {
+    return &latency;
+  } else if (!std::strcmp(id, CLAP_EXT_STATE)) {
+    return &state;
+  }
+  return nullptr;
+}
+
+void pluginOnMainThread(const clap_plugin_t* plugin)
+{
+  // nothing to do
+}
+
+std::uint32_t factoryCount(const clap_plugin_factory_t* factory)
+{
+  return 1;
+}
+
+const clap_plugin_descriptor_t* factoryDescriptor(const clap_plugin_factory_t* factory, std::uint32_t index)
+{
+  return index == 0 ? &descriptor : nullptr;
+}
+
+const clap_plugin_t* factoryCreate(const clap_plugin_factory_t* factory, const clap_host_t* host, const char* pluginID)
+{
+  if (!clap_version_is_compatible(host->clap_version) || std::strcmp(pluginID, descriptor.id)) {
+    return nullptr;
+  }
+  NWClapInstrument* inst = new NWClapInstrument(host);
+  inst->plugin = {
+    &descriptor,
+    inst,
+    pluginInit,
+    pluginDestroy,
+    pluginActivate,
+    pluginDeactivate,
+    pluginStartProcessing,
+    pluginStopProcessing,
+    pluginReset,
+    pluginProcess,
+    pluginGetExtension,
+    pluginOnMainThread,
+  };
+  return &inst->plugin;
+}
+
+const clap_plugin_factory_t factory = { factoryCount, factoryDescriptor, factoryCreate };
+
+bool entryInit(const char* pluginPath)
+{
+  return true;
+}
+
+void entryDeinit()
+{
+  // nothing to do
+}
+
+const void* entryGetFactory(const char* factoryID)
+{
+  return std::strcmp(factoryID, CLAP_PLUGIN_FACTORY_ID) ? nullptr : &factory;
+}
+
+}
+
+extern "C" CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+  CLAP_VERSION_INIT,
+  entryInit,
+  entryDeinit,
+  entryGetFactory,
+};
@@ -1,4 +1,18 @@
 #include "codec/sampledata.h"
+#include "synth/synthcontext.h"
+#include "synth/iinterpolator.h"
+#include "archivecache.h"
+#include "bankcache.h"
+#include "nwplayer.h"
+#include "prerenderer.h"
+#include "prerendertrack.h"
+#include "rvl/rseqfile.h"
+#include "rvl/rbnkfile.h"
+#include "rvl/rwarfile.h"
+#include "rvl/infochunk.h"
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 // This include should come last to avoid namespace collisions.
 #include "plugin/baseplugin.h"
@@ -10,6 +24,11 @@
 // In the functions below, ctx->openFile() is provided by the plugin interface. Use
 // this instead of standard library functions to open additional files in order to use
 // the host's virtual filesystem.
+//
+// Every SEQ entry of an archive is a subsong, selected by a "?name" or "?number"
+// suffix on the filename (the same form Audacious uses for subtunes). A filename
+// without a suffix plays the first sequence. The archive itself is parsed once per
+// process and shared by every call that refers to it; see ArchiveCache.
 
 struct ClefPluginInfo {
   CLEF_PLUGIN_STATIC_FIELDS
@@ -17,42 +36,152 @@ struct ClefPluginInfo {
   using ClapPlugin = ClefClapPlugin<ClefPluginInfo>;
 #endif
 
+  static constexpr int SAMPLE_RATE = 44100;
+  static constexpr double MAX_PRERENDER_DEPTH = 10.0;
+
+  // How far ahead of the host to render, in seconds. Deeper buffers ride out
+  // longer bursts of expensive passages at the cost of memory. Set with
+  // NW_CLEF_PRERENDER=seconds.
+  double prerenderDepth = prerenderDepthSetting();
+
   static bool isPlayable(std::istream& file) {
-    // Implementations should check to see if the file is supported.
-    // Return false or throw an exception to report failure.
-    return false;
+    char magic[4];
+    if (!file.read(magic, 4)) {
+      return false;
+    }
+    return !std::memcmp(magic, "RSAR", 4);
   }
 
   static int sampleRate(ClefContext* ctx, const std::string& filename, std::istream& file) {
-    // Implementations should return the sample rate of the file.
-    // This can be hard-coded if the plugin always uses the same sample rate.
-    return 48000;
+    return SAMPLE_RATE;
   }
 
   static double length(ClefContext* ctx, const std::string& filename, std::istream& file) {
-    // Implementations should return the length of the file in seconds.
-    return 0;
+    std::string subsong;
+    auto archive = openArchive(filename, file, subsong);
+    int index = ArchiveCache::findSubsong(archive.get(), subsong);
+    if (index < 0) {
+      return 0;
+    }
+    return archive->duration(index);
   }
 
   static TagMap readTags(ClefContext* ctx, const std::string& filename, std::istream& file) {
-    // Implementations should read the tags from the file.
-    // If the file format does not support embedded tags, consider
-    // inheriting from TagsM3UMixin and removing this function.
-    return TagMap();
+    std::string subsong;
+    auto archive = openArchive(filename, file, subsong);
+    int index = ArchiveCache::findSubsong(archive.get(), subsong);
+    if (index < 0) {
+      return TagMap();
+    }
+    TagMap tags;
+    tags["title"] = archive->name(index);
+    tags["album"] = archiveTitle(archive->path());
+    tags["track"] = std::to_string(index + 1);
+    return tags;
   }
 
-  SynthContext* prepare(ClefContext* ctx, const std::string& filename, std::istream& file) {
-    // Prepare to play the file. Load any necessary data into memory and store any
-    // applicable state in members on this plugin object.
+  // Lists every sequence of the archive as a filename that selects it.
+  static std::vector<std::string> subsongs(ClefContext* ctx, const std::string& filename, std::istream& file) {
+    std::string subsong;
+    auto archive = openArchive(filename, file, subsong);
+    std::vector<std::string> result;
+    for (int i = 0; i < archive->numSequences(); i++) {
+      result.push_back(archive->path() + "?" + archive->name(i));
+    }
+    return result;
+  }
 
+  SynthContext* prepare(ClefContext* ctx, const std::string& filename, std::istream& file) {
     // Be sure to call this to clear the sample cache:
     ctx->purgeSamples();
+    release();
+
+    std::string subsong;
+    archive = openArchive(filename, file, subsong);
+    int index = ArchiveCache::findSubsong(archive.get(), subsong);
+    if (index < 0) {
+      throw std::runtime_error("no sequence \"" + subsong + "\" in archive");
+    }
+    const SoundDataEntry& sound = archive->sound(index);
+    bank = archive->banks->get(sound.seqData.bankIndex);
+    RBNKFile* rbnk = bank->rbnk.get();
+    RWARFile* rwar = bank->rwar.get();
 
-    return nullptr;
+    // Playback is rendered ahead on a background thread by an NWPlayer, which
+    // decodes every wave the sequence plays while it is prepared. The waves
+    // stay in the cache until playback ends.
+    sampleCache = ArchiveCache::instance()->sampleCache();
+    cacheToken = sampleCache->beginSequence();
+    seq.reset(archive->loadSequence(index, ctx));
+    seq->loadBank(nullptr, rbnk, rwar, nullptr, sound.seqData.channelPriority, sound.panCurve);
+    player.reset(new NWPlayer(SAMPLE_RATE));
+    if (!player->prepare(seq.get(), rwar, sound.panCurve)) {
+      std::string name = archive->name(index);
+      release();
+      throw std::runtime_error("sequence \"" + name + "\" has nothing to play");
+    }
+    prerenderer.reset(new Prerenderer(player.get(), prerenderDepth));
+    track.reset(new PrerenderTrack(prerenderer.get(), player->duration()));
+
+    synth.reset(new SynthContext(ctx, SAMPLE_RATE, 2));
+    synth->interpolator = IInterpolator::get(IInterpolator::Linear);
+    synth->addChannel(track.get());
+    prerenderer->start();
+    return synth.get();
   }
 
   void release() {
-    // Release any retained state allocated in prepare().
+    synth.reset();
+    track.reset();
+    prerenderer.reset();
+    player.reset();
+    seq.reset();
+    bank.reset();
+    if (sampleCache) {
+      sampleCache->endSequence(cacheToken);
+      sampleCache = nullptr;
+    }
+    archive.reset();
+  }
+
+  ~ClefPluginInfo() {
+    release();
+  }
+
+  std::shared_ptr<ArchiveCache::Archive> archive;
+  std::shared_ptr<BankCache::Bank> bank;
+  std::unique_ptr<RSEQFile> seq;
+  std::unique_ptr<NWPlayer> player;
+  std::unique_ptr<Prerenderer> prerenderer;
+  std::unique_ptr<PrerenderTrack> track;
+  std::unique_ptr<SynthContext> synth;
+  SampleCache* sampleCache = nullptr;
+  std::uint64_t cacheToken = 0;
+
+private:
+  static double prerenderDepthSetting() {
+    const char* setting = std::getenv("NW_CLEF_PRERENDER");
+    if (!setting) {
+      return Prerenderer::DEFAULT_DEPTH;
+    }
+    double depth = std::atof(setting);
+    if (depth <= 0) {
+      return Prerenderer::DEFAULT_DEPTH;
+    }
+    return depth < MAX_PRERENDER_DEPTH ? depth : MAX_PRERENDER_DEPTH;
+  }
+
+  static std::shared_ptr<ArchiveCache::Archive> openArchive(const std::string& filename, std::istream& file,
+      std::string& subsong) {
+    std::string path = ArchiveCache::splitSubsong(filename, subsong);
+    return ArchiveCache::instance()->open(path, file);
+  }
+
+  static std::string archiveTitle(const std::string& path) {
+    std::size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    std::size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
   }
 };
 
@@ -0,0 +1,156 @@
+#include "archivecache.h"
+#include "bankcache.h"
+#include "nwchunk.h"
+#include "rvl/rsarfile.h"
+#include "rvl/rseqfile.h"
+#include "rvl/infochunk.h"
+#include <istream>
+
+ArchiveCache::Archive::Archive(const std::string& path, std::uint64_t size)
+: archivePath(path), size(size)
+{
+  // initializers only
+}
+
+const SoundDataEntry& ArchiveCache::Archive::sound(int subsong) const
+{
+  return file->info->soundDataEntries.at(sequences.at(subsong));
+}
+
+int ArchiveCache::Archive::find(const std::string& name) const
+{
+  for (int i = 0; i < names.size(); i++) {
+    if (names[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+double ArchiveCache::Archive::duration(int subsong)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (durations.at(subsong) >= 0) {
+      return durations[subsong];
+    }
+  }
+  // Parsed outside of the lock so that other sequences can be looked up in
+  // the meantime. Two callers may both parse the same sequence, which is
+  // harmless.
+  std::unique_ptr<RSEQFile> seq(loadSequence(subsong, file->ctx));
+  double length = seq->sequence()->duration();
+  std::lock_guard<std::mutex> lock(mutex);
+  durations[subsong] = length;
+  return length;
+}
+
+RSEQFile* ArchiveCache::Archive::loadSequence(int subsong, ClefContext* clef) const
+{
+  auto seqFile = file->getFile(sound(subsong).fileIndex, false);
+  return NWChunk::load<RSEQFile>(seqFile, nullptr, clef);
+}
+
+ArchiveCache* ArchiveCache::instance()
+{
+  static ArchiveCache cache;
+  return &cache;
+}
+
+ArchiveCache::ArchiveCache(int maxArchives, std::size_t sampleBudget)
+: hits(0), loads(0), samples(sampleBudget), maxArchives(maxArchives)
+{
+  // initializers only
+}
+
+std::shared_ptr<ArchiveCache::Archive> ArchiveCache::open(const std::string& path, std::istream& file)
+{
+  file.clear();
+  file.seekg(0, std::ios::end);
+  std::uint64_t size = file.tellg();
+  file.seekg(0);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto iter = archives.begin(); iter != archives.end(); ++iter) {
+      if ((*iter)->path() == path && (*iter)->size == size) {
+        ++hits;
+        archives.splice(archives.begin(), archives, iter);
+        return archives.front();
+      }
+    }
+  }
+
+  // Parsed outside of the lock so that lookups of other archives don't wait
+  // on it.
+  std::shared_ptr<Archive> archive(new Archive(path, size));
+  archive->file.reset(NWChunk::load<RSARFile>(file, nullptr, &clef));
+  archive->banks.reset(new BankCache(archive->file.get(), &clef, &samples));
+  const auto& entries = archive->file->info->soundDataEntries;
+  for (int i = 0; i < entries.size(); i++) {
+    if (entries[i].soundType == SoundType::SEQ) {
+      archive->sequences.push_back(i);
+      archive->names.push_back(entries[i].name);
+    }
+  }
+  archive->durations.resize(archive->sequences.size(), -1);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto iter = archives.begin(); iter != archives.end(); ++iter) {
+    if ((*iter)->path() != path) {
+      continue;
+    }
+    if ((*iter)->size == size) {
+      // Another caller parsed the same file in the meantime; use theirs so
+      // that both share one set of banks.
+      ++hits;
+      archives.splice(archives.begin(), archives, iter);
+      return archives.front();
+    }
+    // The file has changed on disk. Anything still playing the old parse
+    // keeps it alive until it's done.
+    archives.erase(iter);
+    break;
+  }
+  ++loads;
+
+  archives.push_front(archive);
+  while (archives.size() > maxArchives) {
+    archives.pop_back();
+  }
+  return archive;
+}
+
+std::string ArchiveCache::splitSubsong(const std::string& filename, std::string& subsong)
+{
+  std::size_t pos = filename.rfind('?');
+  if (pos == std::string::npos) {
+    subsong.clear();
+    return filename;
+  }
+  subsong = filename.substr(pos + 1);
+  return filename.substr(0, pos);
+}
+
+int ArchiveCache::findSubsong(const Archive* archive, const std::string& subsong)
+{
+  if (!archive->numSequences()) {
+    return -1;
+  }
+  if (subsong.empty()) {
+    return 0;
+  }
+  int index = archive->find(subsong);
+  if (index >= 0) {
+    return index;
+  }
+  if (subsong.find_first_not_of("0123456789") != std::string::npos) {
+    return -1;
+  }
+  try {
+    index = std::stoi(subsong) - 1;
+  } catch (...) {
+    return -1;
+  }
+  return index >= 0 && index < archive->numSequences() ? index : -1;
+}
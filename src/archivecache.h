@@ -0,0 +1,106 @@
+#ifndef NW_ARCHIVECACHE_H
+#define NW_ARCHIVECACHE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "clefcontext.h"
+#include "samplecache.h"
+class RSARFile;
+class RSEQFile;
+class SoundDataEntry;
+class BankCache;
+
+// Parsed sound archives kept for the life of the process, for hosts that ask
+// about the sequences of one archive many times over: once for each of the
+// length, tags and playback of every sequence. The archive is parsed on the
+// first request, and the same parse, sequence names, durations and banks are
+// used by every later one.
+//
+// Archives are owned by the cache's own ClefContext, so they can outlive the
+// context of the host call that opened them, and their decoded waves are kept
+// in one sample cache shared by all of them.
+class ArchiveCache
+{
+public:
+  // One archive and the SEQ entries in it. A sequence is referred to by its
+  // position among the SEQ entries, which is its subsong number.
+  class Archive
+  {
+    friend class ArchiveCache;
+
+  public:
+    Archive(const Archive& other) = delete;
+    Archive& operator=(const Archive& other) = delete;
+
+    inline const std::string& path() const { return archivePath; }
+    inline int numSequences() const { return sequences.size(); }
+    inline const std::string& name(int subsong) const { return names[subsong]; }
+    const SoundDataEntry& sound(int subsong) const;
+
+    // Returns -1 if there is no sequence by that name.
+    int find(const std::string& name) const;
+
+    // Parses the sequence on first use; the result is remembered.
+    double duration(int subsong);
+
+    // Parses a fresh copy of the sequence for playback, without a bank.
+    RSEQFile* loadSequence(int subsong, ClefContext* clef) const;
+
+    std::unique_ptr<RSARFile> file;
+    std::unique_ptr<BankCache> banks;
+
+  private:
+    Archive(const std::string& path, std::uint64_t size);
+
+    std::string archivePath;
+    std::uint64_t size;
+    std::vector<int> sequences;
+    std::vector<std::string> names;
+    std::mutex mutex;
+    std::vector<double> durations;
+  };
+
+  static ArchiveCache* instance();
+
+  ArchiveCache(int maxArchives = DEFAULT_ARCHIVES, std::size_t sampleBudget = DEFAULT_SAMPLE_BUDGET);
+  ArchiveCache(const ArchiveCache& other) = delete;
+  ArchiveCache& operator=(const ArchiveCache& other) = delete;
+
+  // A playlist usually walks through one archive at a time; a few are kept
+  // so that going back and forth between them doesn't reparse.
+  static constexpr int DEFAULT_ARCHIVES = 4;
+  static constexpr std::size_t DEFAULT_SAMPLE_BUDGET = std::size_t(256) << 20;
+
+  // Returns the cached parse of the file at path, or parses it from the
+  // stream. A file whose size has changed since it was cached is parsed
+  // again. Throws if the file can't be parsed.
+  std::shared_ptr<Archive> open(const std::string& path, std::istream& file);
+
+  inline SampleCache* sampleCache() { return &samples; }
+
+  // Splits "archive.brsar?subsong" into the archive path and the subsong
+  // part. The subsong part is empty if there is none.
+  static std::string splitSubsong(const std::string& filename, std::string& subsong);
+
+  // Resolves a subsong part to a sequence of the archive: either the name of
+  // the sequence or its 1-based number. An empty subsong is the first
+  // sequence. Returns -1 if nothing matches.
+  static int findSubsong(const Archive* archive, const std::string& subsong);
+
+  std::uint64_t hits;
+  std::uint64_t loads;
+
+private:
+  ClefContext clef;
+  SampleCache samples;
+  int maxArchives;
+  std::mutex mutex;
+  std::list<std::shared_ptr<Archive>> archives;
+};
+
+#endif
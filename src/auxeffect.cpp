@@ -0,0 +1,72 @@
+#include "auxeffect.h"
+
+// Delay lengths in samples at 44100 Hz.
+static const int combTuning[] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
+static const int allpassTuning[] = { 556, 441, 341, 225 };
+static constexpr int stereoSpread = 23;
+
+ReverbEffect::ReverbEffect(double sampleRate, double roomSize, double damping, double gain)
+: feedback(roomSize), damp(damping), gain(gain * 0.045)
+{
+  double scale = sampleRate / 44100.0;
+  for (int ch = 0; ch < 2; ch++) {
+    int spread = ch ? stereoSpread : 0;
+    for (int i = 0; i < NUM_COMBS; i++) {
+      combs[ch][i].buffer.assign(int((combTuning[i] + spread) * scale), 0.0f);
+    }
+    for (int i = 0; i < NUM_ALLPASSES; i++) {
+      allpasses[ch][i].buffer.assign(int((allpassTuning[i] + spread) * scale), 0.0f);
+    }
+  }
+}
+
+void ReverbEffect::process(float* samples, int frames)
+{
+  for (int ch = 0; ch < 2; ch++) {
+    for (int f = 0; f < frames; f++) {
+      float input = samples[f * 2 + ch] * gain;
+      float out = 0;
+      for (Comb& comb : combs[ch]) {
+        float delayed = comb.buffer[comb.pos];
+        comb.store = delayed * (1 - damp) + comb.store * damp;
+        comb.buffer[comb.pos] = input + comb.store * feedback;
+        if (++comb.pos >= int(comb.buffer.size())) {
+          comb.pos = 0;
+        }
+        out += delayed;
+      }
+      for (Allpass& allpass : allpasses[ch]) {
+        float delayed = allpass.buffer[allpass.pos];
+        allpass.buffer[allpass.pos] = out + delayed * 0.5f;
+        if (++allpass.pos >= int(allpass.buffer.size())) {
+          allpass.pos = 0;
+        }
+        out = delayed - out;
+      }
+      samples[f * 2 + ch] = out;
+    }
+  }
+}
+
+DelayEffect::DelayEffect(double sampleRate, double delayTime, double feedback, double gain)
+: length(int(delayTime * sampleRate)), pos(0), feedback(feedback), gain(gain)
+{
+  if (length < 1) {
+    length = 1;
+  }
+  buffer.assign(length * 2, 0.0f);
+}
+
+void DelayEffect::process(float* samples, int frames)
+{
+  for (int f = 0; f < frames; f++) {
+    for (int ch = 0; ch < 2; ch++) {
+      float delayed = buffer[pos * 2 + ch];
+      buffer[pos * 2 + ch] = samples[f * 2 + ch] + delayed * feedback;
+      samples[f * 2 + ch] = delayed * gain;
+    }
+    if (++pos >= length) {
+      pos = 0;
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef NW_AUXEFFECT_H
+#define NW_AUXEFFECT_H
+
+#include <vector>
+
+// An effect on one of the shared aux buses. Effects process a whole block of
+// interleaved stereo at once, replacing the dry input with the wet output.
+class AuxEffect
+{
+public:
+  virtual ~AuxEffect() {}
+
+  virtual void process(float* samples, int frames) = 0;
+};
+
+// A Schroeder-Moorer reverb (parallel damped combs into series allpasses per
+// channel), tuned for a long hall like the default NW4R reverb.
+class ReverbEffect : public AuxEffect
+{
+public:
+  ReverbEffect(double sampleRate, double roomSize = 0.84, double damping = 0.3, double gain = 1.0);
+
+  virtual void process(float* samples, int frames) override;
+
+private:
+  struct Comb {
+    std::vector<float> buffer;
+    int pos = 0;
+    float store = 0;
+  };
+
+  struct Allpass {
+    std::vector<float> buffer;
+    int pos = 0;
+  };
+
+  static constexpr int NUM_COMBS = 8;
+  static constexpr int NUM_ALLPASSES = 4;
+
+  Comb combs[2][NUM_COMBS];
+  Allpass allpasses[2][NUM_ALLPASSES];
+  float feedback;
+  float damp;
+  float gain;
+};
+
+// A stereo feedback delay.
+class DelayEffect : public AuxEffect
+{
+public:
+  DelayEffect(double sampleRate, double delayTime, double feedback, double gain = 1.0);
+
+  virtual void process(float* samples, int frames) override;
+
+private:
+  std::vector<float> buffer;
+  int length;
+  int pos;
+  float feedback;
+  float gain;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "bankcache.h"
+#include "nwchunk.h"
+#include "rvl/rsarfile.h"
+#include "rvl/rbnkfile.h"
+#include "rvl/rwarfile.h"
+#include "rvl/infochunk.h"
+
+BankCache::BankCache(const RSARFile* archive, ClefContext* clef, SampleCache* sampleCache, bool directADPCM)
+: hits(0), loads(0), archive(archive), clef(clef), sampleCache(sampleCache), directADPCM(directADPCM)
+{
+  // initializers only
+}
+
+std::shared_ptr<BankCache::Bank> BankCache::get(int bankIndex)
+{
+  Slot* slot;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Slot>& entry = banks[bankIndex];
+    if (!entry) {
+      entry.reset(new Slot);
+    }
+    slot = entry.get();
+  }
+
+  // Only sequences waiting for the same bank wait for each other here; other
+  // banks can be loaded at the same time.
+  std::lock_guard<std::mutex> lock(slot->loading);
+  if (slot->bank) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++hits;
+    return slot->bank;
+  }
+
+  auto bankEntry = archive->info->soundBankEntries.at(bankIndex);
+  std::shared_ptr<Bank> bank(new Bank);
+  auto bankFile = archive->getFile(bankEntry.fileIndex, false);
+  bank->rbnk.reset(NWChunk::load<RBNKFile>(bankFile, nullptr, clef));
+  auto audioFile = archive->getFile(bankEntry.fileIndex, true);
+  bank->rwar.reset(NWChunk::load<RWARFile>(audioFile, nullptr, clef));
+  bank->rwar->setDirectADPCM(directADPCM);
+  bank->rwar->setSampleCache(sampleCache);
+  slot->bank = bank;
+
+  std::lock_guard<std::mutex> countLock(mutex);
+  ++loads;
+  return bank;
+}
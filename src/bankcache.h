@@ -0,0 +1,54 @@
+#ifndef NW_BANKCACHE_H
+#define NW_BANKCACHE_H
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+class ClefContext;
+class RSARFile;
+class RBNKFile;
+class RWARFile;
+class SampleCache;
+
+// Parsed banks and wave archives of one sound archive, keyed by bank index.
+// Sequences that use the same bank share one RBNK/RWAR pair instead of
+// parsing their own. Banks are only read once they are set up, so the same
+// pair can be used by sequences rendering on different threads.
+class BankCache
+{
+public:
+  struct Bank {
+    std::unique_ptr<RBNKFile> rbnk;
+    std::unique_ptr<RWARFile> rwar;
+  };
+
+  // The sample cache and ADPCM mode are applied to every wave archive when it
+  // is loaded.
+  BankCache(const RSARFile* archive, ClefContext* clef, SampleCache* sampleCache = nullptr, bool directADPCM = false);
+  BankCache(const BankCache& other) = delete;
+  BankCache& operator=(const BankCache& other) = delete;
+
+  // Loads the bank on first use. Throws if the bank can't be parsed, in which
+  // case the next call tries again.
+  std::shared_ptr<Bank> get(int bankIndex);
+
+  inline std::size_t size() const { return banks.size(); }
+
+  std::uint64_t hits;
+  std::uint64_t loads;
+
+private:
+  struct Slot {
+    std::mutex loading;
+    std::shared_ptr<Bank> bank;
+  };
+
+  const RSARFile* archive;
+  ClefContext* clef;
+  SampleCache* sampleCache;
+  bool directADPCM;
+  std::mutex mutex;
+  std::unordered_map<int, std::unique_ptr<Slot>> banks;
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include "batchrunner.h"
+#include "threadpool.h"
+#include "bankcache.h"
+#include "listactions.h"
+#include "nwchunk.h"
+#include "rvl/rsarfile.h"
+#include "rvl/infochunk.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+BatchJournal::BatchJournal(const std::string& path)
+: valid(false)
+{
+  bool terminated = true;
+  {
+    std::ifstream is(path);
+    std::string line;
+    while (std::getline(is, line)) {
+      // getline() only stops short of the end of the file at a newline. A
+      // last line without one was cut short by an interrupted write, and
+      // may be a prefix of a real entry, so it doesn't count.
+      if (is.eof()) {
+        terminated = false;
+        break;
+      }
+      if (line.find('\t') != std::string::npos) {
+        done.insert(line);
+      }
+    }
+  }
+  file.open(path, std::ios::out | std::ios::app);
+  if (!terminated) {
+    // Finish the partial line so that the next entry starts on its own.
+    file << std::endl;
+  }
+  valid = bool(file);
+}
+
+bool BatchJournal::contains(const std::string& archive, const std::string& sound) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return done.count(archive + "\t" + sound);
+}
+
+void BatchJournal::record(const std::string& archive, const std::string& sound)
+{
+  std::string key = archive + "\t" + sound;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (done.insert(key).second) {
+    file << key << std::endl;
+  }
+}
+
+BatchRunner::BatchRunner(ClefContext* clef, ThreadPool* pool, const PrepareFn& prepare, const RenderFn& render)
+: rendered(0), skipped(0), failed(0), clef(clef), pool(pool), prepare(prepare), render(render), journal(nullptr),
+  filter(nullptr), extension(".wav"), sampleCache(nullptr), directADPCM(false), queued(0), capacity(0), parsing(false)
+{
+  // initializers only
+}
+
+void BatchRunner::setJournal(BatchJournal* journal)
+{
+  this->journal = journal;
+}
+
+void BatchRunner::setFilter(const Glob* filter)
+{
+  this->filter = filter;
+}
+
+void BatchRunner::setOutput(const std::string& outPath, const std::string& extension)
+{
+  this->outPath = outPath;
+  this->extension = extension;
+}
+
+void BatchRunner::setBankOptions(SampleCache* sampleCache, bool directADPCM)
+{
+  this->sampleCache = sampleCache;
+  this->directADPCM = directADPCM;
+}
+
+bool BatchRunner::addInput(const std::string& path, std::string& error)
+{
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::path fsPath = fs::absolute(path, ec).lexically_normal();
+  if (!fs::is_directory(fsPath, ec)) {
+    if (!fs::exists(fsPath, ec)) {
+      error = "\"" + path + "\" does not exist";
+      return false;
+    }
+    inputs.push_back(fsPath.string());
+    return true;
+  }
+
+  std::vector<std::string> found;
+  for (fs::recursive_directory_iterator iter(fsPath, ec), end; !ec && iter != end; iter.increment(ec)) {
+    if (!iter->is_regular_file(ec)) {
+      continue;
+    }
+    std::string ext = iter->path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".brsar") {
+      found.push_back(iter->path().string());
+    }
+  }
+  if (ec) {
+    error = "unable to read directory \"" + path + "\"";
+    return false;
+  }
+  // Directory order depends on the filesystem; sort so that output names and
+  // the order of the log are the same on every run.
+  std::sort(found.begin(), found.end());
+  inputs.insert(inputs.end(), found.begin(), found.end());
+  return true;
+}
+
+bool BatchRunner::addManifest(const std::string& path, std::string& error)
+{
+  std::ifstream is(path);
+  if (!is) {
+    error = "unable to open manifest \"" + path + "\"";
+    return false;
+  }
+  std::filesystem::path base = std::filesystem::path(path).parent_path();
+  std::string line;
+  while (std::getline(is, line)) {
+    line.erase(0, line.find_first_not_of(" \t\r"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    // Relative entries are relative to the manifest, not the working directory.
+    std::filesystem::path entry(line);
+    if (entry.is_relative()) {
+      entry = base / entry;
+    }
+    if (!addInput(entry.string(), error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int BatchRunner::run()
+{
+  int numWorkers = pool ? pool->size() : 1;
+
+  // Archives with the same name in different directories get numbered output
+  // directories, in input order.
+  std::map<std::string, int> stems;
+  std::vector<std::shared_ptr<Archive>> archives;
+  for (const std::string& input : inputs) {
+    std::string stem = std::filesystem::path(input).stem().string();
+    int count = ++stems[stem];
+    if (count > 1) {
+      stem += "-" + std::to_string(count);
+    }
+    if (journal && journal->contains(input)) {
+      ++skipped;
+      continue;
+    }
+    std::shared_ptr<Archive> archive(new Archive);
+    archive->path = input;
+    archive->outDir = (std::filesystem::path(outPath) / stem).string();
+    archive->pending = 0;
+    archive->hasFailures = false;
+    archives.push_back(archive);
+  }
+
+  // Two prepared sequences per worker keep every worker busy without holding
+  // many parsed sequences in memory.
+  queues.clear();
+  queues.resize(numWorkers);
+  queued = 0;
+  capacity = numWorkers * 2;
+  parsing = true;
+
+  std::thread parser(&BatchRunner::parseStage, this, std::cref(archives));
+  if (pool) {
+    pool->run(numWorkers, [this](int worker){ renderStage(worker); });
+  } else {
+    renderStage(0);
+  }
+  parser.join();
+  queues.clear();
+  return failed;
+}
+
+void BatchRunner::parseStage(const std::vector<std::shared_ptr<Archive>>& archives)
+{
+  int numWorkers = queues.size();
+  int nextWorker = 0;
+  for (const std::shared_ptr<Archive>& archive : archives) {
+    std::vector<int> sounds;
+    if (!openArchive(archive.get(), sounds)) {
+      continue;
+    }
+    // Counted up front so that the archive isn't released while its later
+    // sequences are still being parsed.
+    archive->pending = sounds.size();
+    for (int sound : sounds) {
+      Item item{ archive, sound, nullptr };
+      try {
+        item.prepared = prepare(archive->file.get(), archive->banks.get(), archive->file->info->soundDataEntries[sound]);
+      } catch (std::exception& e) {
+        finishItem(item, 1, std::string(), std::string(e.what()) + "\n");
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      space.wait(lock, [this]{ return queued < capacity; });
+      queues[nextWorker].push_back(std::move(item));
+      nextWorker = (nextWorker + 1) % numWorkers;
+      ++queued;
+      ready.notify_all();
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  parsing = false;
+  ready.notify_all();
+}
+
+void BatchRunner::renderStage(int worker)
+{
+  Item item;
+  while (take(worker, item)) {
+    Archive* archive = item.archive.get();
+    const SoundDataEntry& sound = archive->file->info->soundDataEntries[item.sound];
+    std::string outFilename = archive->outDir + "/" + sound.name + extension;
+    std::ostringstream out, err;
+    int result;
+    try {
+      result = render(item.prepared.get(), outFilename, out, err);
+    } catch (std::exception& e) {
+      err << e.what() << std::endl;
+      result = 1;
+    }
+    finishItem(item, result, out.str(), err.str());
+  }
+}
+
+bool BatchRunner::take(int worker, Item& item)
+{
+  // Workers take their own items from the front, in order, and steal from
+  // the back of the others, where the work furthest from being reached is.
+  std::unique_lock<std::mutex> lock(mutex);
+  int numWorkers = queues.size();
+  while (true) {
+    for (int i = 0; i < numWorkers; i++) {
+      std::deque<Item>& queue = queues[(worker + i) % numWorkers];
+      if (queue.empty()) {
+        continue;
+      }
+      if (i == 0) {
+        item = std::move(queue.front());
+        queue.pop_front();
+      } else {
+        item = std::move(queue.back());
+        queue.pop_back();
+      }
+      --queued;
+      space.notify_one();
+      return true;
+    }
+    if (!parsing) {
+      return false;
+    }
+    ready.wait(lock);
+  }
+}
+
+bool BatchRunner::openArchive(Archive* archive, std::vector<int>& sounds)
+{
+  try {
+    std::ifstream is(archive->path, std::ios::in | std::ios::binary);
+    if (!is) {
+      throw std::runtime_error("unable to open file");
+    }
+    archive->file.reset(NWChunk::load<RSARFile>(is, nullptr, clef));
+    archive->banks.reset(new BankCache(archive->file.get(), clef, sampleCache, directADPCM));
+    const auto& entries = archive->file->info->soundDataEntries;
+    for (int i = 0; i < entries.size(); i++) {
+      const SoundDataEntry& sound = entries[i];
+      if (sound.soundType != SoundType::SEQ || (filter && !filter->match(sound.name))) {
+        continue;
+      }
+      if (journal && journal->contains(archive->path, sound.name)) {
+        ++skipped;
+        continue;
+      }
+      sounds.push_back(i);
+    }
+  } catch (std::exception& e) {
+    ++failed;
+    report(std::string(), archive->path + ": " + e.what() + "\n");
+    return false;
+  }
+
+  if (sounds.empty()) {
+    archive->banks.reset();
+    archive->file.reset();
+    if (journal) {
+      journal->record(archive->path);
+    }
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(archive->outDir, ec);
+  return true;
+}
+
+void BatchRunner::finishItem(Item& item, int result, const std::string& out, const std::string& err)
+{
+  Archive* archive = item.archive.get();
+  const std::string& name = archive->file->info->soundDataEntries[item.sound].name;
+  if (result) {
+    ++failed;
+    archive->hasFailures = true;
+    report(out, archive->path + ": " + name + ": failed" + (err.empty() ? "\n" : ": " + err));
+  } else {
+    ++rendered;
+    if (journal) {
+      journal->record(archive->path, name);
+    }
+    report(out, err);
+  }
+
+  // The last sequence of an archive releases it, so only the archives that
+  // are being worked on stay in memory.
+  item.prepared.reset();
+  if (--archive->pending > 0) {
+    return;
+  }
+  archive->banks.reset();
+  archive->file.reset();
+  if (journal && !archive->hasFailures) {
+    journal->record(archive->path);
+  }
+}
+
+void BatchRunner::report(const std::string& out, const std::string& err)
+{
+  std::lock_guard<std::mutex> lock(reportMutex);
+  std::cout << out << std::flush;
+  std::cerr << err << std::flush;
+}
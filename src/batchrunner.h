@@ -0,0 +1,145 @@
+#ifndef NW_BATCHRUNNER_H
+#define NW_BATCHRUNNER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+class ClefContext;
+class RSARFile;
+class SoundDataEntry;
+class ThreadPool;
+class Glob;
+class BankCache;
+class SampleCache;
+
+// Append-only record of finished work items. Each line is an archive path and
+// a sound name separated by a tab; an empty sound name marks an archive whose
+// every sequence has been rendered. Lines are flushed as they are written, so
+// an interrupted run leaves a journal that a new run can resume from.
+class BatchJournal
+{
+public:
+  BatchJournal(const std::string& path);
+
+  inline bool isValid() const { return valid; }
+  inline std::size_t size() const { return done.size(); }
+
+  bool contains(const std::string& archive, const std::string& sound = std::string()) const;
+  void record(const std::string& archive, const std::string& sound = std::string());
+
+private:
+  mutable std::mutex mutex;
+  std::unordered_set<std::string> done;
+  std::ofstream file;
+  bool valid;
+};
+
+// Renders every matching sequence of many archives in three stages that run
+// at the same time:
+//
+//  - A parse thread opens the archives in order, then parses each sequence
+//    and loads its bank ahead of rendering.
+//  - Workers on the thread pool render the prepared sequences, streaming each
+//    one to disk as it is rendered, and record it in the journal. Each
+//    worker has its own queue, fed in turn by the parse thread, and an idle
+//    worker steals from the back of the others.
+//
+// The queues are bounded, so the parse thread only runs a few sequences
+// ahead. A failure is reported and counted without stopping the rest of the
+// batch.
+class BatchRunner
+{
+public:
+  // Whatever the render stage needs for one sequence, built by the parse
+  // stage.
+  struct Prepared {
+    virtual ~Prepared() {}
+  };
+
+  using PrepareFn = std::function<std::unique_ptr<Prepared>(const RSARFile* archive, BankCache* banks,
+      const SoundDataEntry& sound)>;
+
+  // Renders to outFilename, writing the output as it goes. Returns nonzero on
+  // failure, with the reason written to err.
+  using RenderFn = std::function<int(Prepared* prepared, const std::string& outFilename,
+      std::ostream& out, std::ostream& err)>;
+
+  BatchRunner(ClefContext* clef, ThreadPool* pool, const PrepareFn& prepare, const RenderFn& render);
+
+  void setJournal(BatchJournal* journal);
+  void setFilter(const Glob* filter);
+  void setOutput(const std::string& outPath, const std::string& extension);
+
+  // Applied to the wave archives of every bank cache the runner creates.
+  void setBankOptions(SampleCache* sampleCache, bool directADPCM);
+
+  // Adds an archive, or every .brsar file below a directory.
+  bool addInput(const std::string& path, std::string& error);
+
+  // Adds each line of a manifest file as an input. Blank lines and lines
+  // starting with '#' are ignored.
+  bool addManifest(const std::string& path, std::string& error);
+
+  // Returns the number of failed items.
+  int run();
+
+  std::size_t numInputs() const { return inputs.size(); }
+
+  std::atomic<int> rendered;
+  std::atomic<int> skipped;
+  std::atomic<int> failed;
+
+private:
+  struct Archive {
+    std::string path;
+    std::string outDir;
+    std::unique_ptr<RSARFile> file;
+    std::unique_ptr<BankCache> banks;
+    std::atomic<int> pending;
+    std::atomic<bool> hasFailures;
+  };
+
+  struct Item {
+    std::shared_ptr<Archive> archive;
+    int sound;
+    std::unique_ptr<Prepared> prepared;
+  };
+
+  void parseStage(const std::vector<std::shared_ptr<Archive>>& archives);
+  void renderStage(int worker);
+  bool openArchive(Archive* archive, std::vector<int>& sounds);
+  bool take(int worker, Item& item);
+  void finishItem(Item& item, int result, const std::string& out, const std::string& err);
+  void report(const std::string& out, const std::string& err);
+
+  ClefContext* clef;
+  ThreadPool* pool;
+  PrepareFn prepare;
+  RenderFn render;
+  BatchJournal* journal;
+  const Glob* filter;
+  std::string outPath;
+  std::string extension;
+  SampleCache* sampleCache;
+  bool directADPCM;
+  std::vector<std::string> inputs;
+
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::condition_variable space;
+  std::vector<std::deque<Item>> queues;
+  int queued;
+  int capacity;
+  bool parsing;
+  std::mutex reportMutex;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef NW_CONTENTHASH_H
+#define NW_CONTENTHASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// Fast non-cryptographic 64-bit hash, processed a word at a time. Used to
+// identify wave data independently of where it was found.
+class ContentHash
+{
+public:
+  inline ContentHash(std::uint64_t seed = 0) : state(seed ^ 0x9E3779B97F4A7C15ULL), length(0) {}
+
+  inline void update(const void* data, std::size_t size)
+  {
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+    length += size;
+    while (size >= 8) {
+      std::uint64_t word;
+      std::memcpy(&word, bytes, 8);
+      mix(word);
+      bytes += 8;
+      size -= 8;
+    }
+    if (size) {
+      std::uint64_t word = 0;
+      std::memcpy(&word, bytes, size);
+      mix(word ^ (std::uint64_t(size) << 56));
+    }
+  }
+
+  template <typename T>
+  inline void add(T value)
+  {
+    update(&value, sizeof(T));
+  }
+
+  inline std::uint64_t digest() const
+  {
+    std::uint64_t h = state ^ length;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+private:
+  inline void mix(std::uint64_t word)
+  {
+    word *= 0x87C37B91114253D5ULL;
+    word = (word << 31) | (word >> 33);
+    word *= 0x4CF5AD432745937FULL;
+    state ^= word;
+    state = ((state << 27) | (state >> 37)) * 5 + 0x52DCE729;
+  }
+
+  std::uint64_t state;
+  std::uint64_t length;
+};
+
+#endif
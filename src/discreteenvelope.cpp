@@ -1,14 +1,59 @@
 #include "discreteenvelope.h"
-#include "utility.h"
-#include <cmath>
+#include "voicepool.h"
+
+DiscreteEnvelope::Stepper::Stepper(double startLevel, double startUser)
+: lastLevel(startLevel), stepAt(0), stepVolume(startLevel), current({ startLevel, 0, false, startUser }), step(0),
+  cullLevel(0), cullHold(0), quietSince(-1), attackPhases(1)
+{
+  // initializers only
+}
+
+void DiscreteEnvelope::Stepper::release(double time)
+{
+  stepAt = time;
+  step = -1;
+  current.nextVolume = lastLevel;
+  current.nextTime = 0;
+  current.finished = false;
+}
 
 DiscreteEnvelope::DiscreteEnvelope(const SynthContext* ctx, double startLevel, double startUser)
-: FilterNode(ctx), lastLevel(startLevel), stepAt(0), stepVolume(startLevel),
-  currentStep({ startLevel, 0, false, startUser }), step(0), allDone(false)
+: FilterNode(ctx), stepper(startLevel, startUser), allDone(false), outputGain(1), pool(nullptr)
 {
   // initializers only
 }
 
+DiscreteEnvelope::~DiscreteEnvelope()
+{
+  if (pool) {
+    pool->release(this);
+  }
+}
+
+void DiscreteEnvelope::kill()
+{
+  allDone = true;
+  stepper.lastLevel = 0;
+}
+
+void DiscreteEnvelope::setAudibilityThreshold(double level, double holdTime, int attackPhases)
+{
+  stepper.cullLevel = level;
+  stepper.cullHold = holdTime;
+  stepper.quietSince = -1;
+  stepper.attackPhases = attackPhases;
+}
+
+void DiscreteEnvelope::attachPool(VoicePool* pool)
+{
+  this->pool = pool;
+}
+
+void DiscreteEnvelope::detachPool()
+{
+  pool = nullptr;
+}
+
 bool DiscreteEnvelope::isActive() const
 {
   return !allDone && FilterNode::isActive();
@@ -26,37 +71,30 @@ void DiscreteEnvelope::setReleasePhase(PhaseFn phase)
 
 int16_t DiscreteEnvelope::filterSample(double time, int channel, int16_t sample)
 {
-  if (step > 0 && paramValue(Trigger, time) <= 0) {
-    stepAt = time;
-    step = -1;
-    currentStep.nextVolume = lastLevel;
-    currentStep.nextTime = 0;
-    currentStep.finished = false;
+  double level = levelAt(time, channel == 0);
+  if (level < 0) {
+    return 0;
   }
-  while (true) {
-    double dt = time - stepAt;
-    bool shouldStep = dt >= currentStep.nextTime;
-    if (shouldStep && currentStep.finished) {
-      ++step;
-    }
-    if ((step == 0 && shouldStep && currentStep.finished) || step >= (int)phases.size()) {
-      allDone = true;
-      return 0;
-    }
-    const PhaseFn& phase = step < 0 ? releasePhase : phases[step];
-    if (!phase) {
-      step = 0;
-      currentStep.finished = true;
+  return level * sample;
+}
+
+double DiscreteEnvelope::levelAt(double time, bool primary)
+{
+  if (allDone) {
+    return -1;
+  }
+  if (stepper.step > 0 && paramValue(Trigger, time) <= 0) {
+    if (!releasePhase) {
       allDone = true;
-      return 0;
+      return -1;
     }
-    if (shouldStep) {
-      stepAt += currentStep.nextTime;
-      stepVolume = currentStep.nextVolume;
-      currentStep = phase(stepVolume, currentStep.userData);
-      continue;
-    }
-    lastLevel = lerp(stepVolume, currentStep.nextVolume, dt / currentStep.nextTime);
-    return lastLevel * sample;
+    stepper.release(time);
+  }
+  double level = stepper.advance(time, phases.size(), primary, outputGain, [this](int phase, double last, double user) {
+    return phase < 0 ? releasePhase(last, user) : phases[phase](last, user);
+  });
+  if (level < 0) {
+    allDone = true;
   }
+  return level;
 }
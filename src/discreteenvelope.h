@@ -3,7 +3,9 @@
 
 #include "synth/audionode.h"
 #include "synth/audioparam.h"
+#include "utility.h"
 #include <functional>
+class VoicePool;
 
 class DiscreteEnvelope : public FilterNode
 {
@@ -16,24 +18,103 @@ public:
   };
   using PhaseFn = std::function<Step(double, double)>;
 
+  // Where an envelope is within its phases. This is kept apart from how the
+  // phases are stored so that NWPlayer can step its envelopes the same way
+  // without a node or a std::function.
+  struct Stepper {
+    Stepper(double startLevel = 0.0, double startUser = 0.0);
+
+    // Switches to the release phase at the specified time.
+    void release(double time);
+
+    // Advances to the specified time and returns the level, or a negative
+    // value once the envelope has finished. next(phase, last, user) returns
+    // the next step of the specified phase, or of the release phase for -1.
+    // The audibility threshold is only checked if cull is set, against the
+    // level times gain, the gain applied to the voice after the envelope.
+    template <typename NextFn>
+    double advance(double time, int numPhases, bool cull, double gain, NextFn next);
+
+    inline bool isReleasing() const { return step < 0; }
+
+    double lastLevel;
+    double stepAt, stepVolume;
+    Step current;
+    int step;
+    double cullLevel, cullHold, quietSince;
+    int attackPhases;
+  };
+
   DiscreteEnvelope(const SynthContext* ctx, double startLevel = 0.0, double startUser = 0.0);
+  ~DiscreteEnvelope();
 
   virtual bool isActive() const;
 
   void addPhase(PhaseFn phase);
   void setReleasePhase(PhaseFn phase);
 
+  inline double level() const { return stepper.lastLevel; }
+  inline bool isReleasing() const { return stepper.isReleasing(); }
+
+  // Silences the voice immediately, e.g. when it is stolen.
+  void kill();
+
+  // Retires the voice once its output has stayed below the specified level
+  // for holdTime seconds. The first attackPhases phases are exempt, so that
+  // a slow attack isn't cut off while it is still quiet.
+  void setAudibilityThreshold(double level, double holdTime, int attackPhases = 1);
+
+  void attachPool(VoicePool* pool);
+  void detachPool();
+
 protected:
   virtual int16_t filterSample(double time, int channel, int16_t sample);
 
-  double lastLevel;
-  double stepAt, stepVolume;
-  Step currentStep;
-  int step;
+  // Advances the envelope to the specified time and returns its level, or a
+  // negative value once the envelope has finished.
+  double levelAt(double time, bool primary = true);
+
+  Stepper stepper;
   std::vector<PhaseFn> phases;
   PhaseFn releasePhase;
   bool allDone;
+  // The gain that subclasses apply after the envelope, for the audibility
+  // threshold.
+  double outputGain;
+  VoicePool* pool;
 };
 
+template <typename NextFn>
+double DiscreteEnvelope::Stepper::advance(double time, int numPhases, bool cull, double gain, NextFn next)
+{
+  while (true) {
+    double dt = time - stepAt;
+    bool shouldStep = dt >= current.nextTime;
+    if (shouldStep && current.finished) {
+      ++step;
+    }
+    if ((step == 0 && shouldStep && current.finished) || step >= numPhases) {
+      return -1;
+    }
+    if (shouldStep) {
+      stepAt += current.nextTime;
+      stepVolume = current.nextVolume;
+      current = next(step, stepVolume, current.userData);
+      continue;
+    }
+    lastLevel = lerp(stepVolume, current.nextVolume, dt / current.nextTime);
+    if (cull && cullLevel > 0 && (step < 0 || step >= attackPhases)) {
+      if (lastLevel * gain >= cullLevel) {
+        quietSince = -1;
+      } else if (quietSince < 0) {
+        quietSince = time;
+      } else if (time - quietSince >= cullHold) {
+        return -1;
+      }
+    }
+    return lastLevel;
+  }
+}
+
 #endif
 
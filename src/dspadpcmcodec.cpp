@@ -15,7 +15,7 @@ DspAdpcmCodec::DspAdpcmCodec(ClefContext* ctx, const DspAdpcmCodec::Params& para
   // initializers only
 }
 
-static inline std::uint32_t convertSampleCount(std::int32_t n)
+std::uint32_t dspAdpcmSampleCount(std::int32_t n)
 {
   n = (n / 16 * 14) + (n % 16) - 2;
   return (n < 0) ? 0 : n;
@@ -25,8 +25,8 @@ SampleData* DspAdpcmCodec::decodeRange(std::vector<uint8_t>::const_iterator star
 {
   SampleData* sample = new SampleData(context(), sampleID);
   sample->sampleRate = params.sampleRate;
-  sample->loopStart = convertSampleCount(params.loopStart);
-  sample->loopEnd = convertSampleCount(params.loopEnd);
+  sample->loopStart = dspAdpcmSampleCount(params.loopStart);
+  sample->loopEnd = dspAdpcmSampleCount(params.loopEnd);
   sample->channels.emplace_back();
   auto& buffer = sample->channels[0];
   buffer.reserve(sample->loopEnd);
@@ -65,3 +65,55 @@ std::int16_t DspAdpcmCodec::getNextSample(std::int32_t state)
   params.history[0] = result;
   return result * params.gain;
 }
+
+DspAdpcmStream::DspAdpcmStream()
+: data(nullptr), coefs(nullptr), length(0), pos(0), scale(0), coef1(0), coef2(0), history{ 0, 0 }
+{
+  // initializers only
+}
+
+DspAdpcmStream::DspAdpcmStream(const std::uint8_t* data, std::uint32_t numSamples, const std::int16_t* coefs, std::int16_t history1, std::int16_t history2)
+: data(data), coefs(coefs), length(numSamples), pos(0), scale(0), coef1(0), coef2(0), history{ history1, history2 }
+{
+  // initializers only
+}
+
+void DspAdpcmStream::seek(std::uint32_t sample, std::int16_t history1, std::int16_t history2)
+{
+  pos = sample;
+  history[0] = history1;
+  history[1] = history2;
+  if (pos % 14) {
+    readHeader();
+  }
+}
+
+void DspAdpcmStream::readHeader()
+{
+  std::uint8_t header = data[(pos / 14) * 8];
+  scale = 1 << (header & 0x0F);
+  int index = (header >> 4) * 2;
+  coef1 = coefs[index];
+  coef2 = coefs[index + 1];
+}
+
+std::int16_t DspAdpcmStream::next()
+{
+  if (pos >= length) {
+    return 0;
+  }
+  std::uint32_t frameIndex = pos % 14;
+  if (frameIndex == 0) {
+    readHeader();
+  }
+  std::uint8_t byte = data[(pos / 14) * 8 + 1 + frameIndex / 2];
+  std::int32_t nibble = signedNibble(byte, frameIndex & 1);
+  ++pos;
+
+  std::int32_t sample = (nibble * scale) << 11;
+  sample = (sample + 1024 + coef1 * history[0] + coef2 * history[1]) >> 11;
+  std::int16_t result = clamp<std::int16_t>(sample, -0x8000, 0x7FFF);
+  history[1] = history[0];
+  history[0] = result;
+  return result;
+}
@@ -28,4 +28,34 @@ private:
   std::int32_t scale, coef1, coef2;
 };
 
+// Incremental decoder for one channel of DSP-ADPCM data, used to play a wave
+// directly from its encoded form instead of decoding it ahead of time.
+class DspAdpcmStream
+{
+public:
+  DspAdpcmStream();
+  DspAdpcmStream(const std::uint8_t* data, std::uint32_t numSamples, const std::int16_t* coefs, std::int16_t history1, std::int16_t history2);
+
+  // Positions the decoder so that the next call to next() returns the
+  // specified sample, given the two samples that precede it.
+  void seek(std::uint32_t sample, std::int16_t history1, std::int16_t history2);
+
+  std::int16_t next();
+  inline std::uint32_t position() const { return pos; }
+  inline std::uint32_t numSamples() const { return length; }
+
+private:
+  void readHeader();
+
+  const std::uint8_t* data;
+  const std::int16_t* coefs;
+  std::uint32_t length;
+  std::uint32_t pos;
+  std::int32_t scale, coef1, coef2;
+  std::int16_t history[2];
+};
+
+// Converts a nibble offset in DSP-ADPCM data to a sample index.
+std::uint32_t dspAdpcmSampleCount(std::int32_t nibbles);
+
 #endif
@@ -254,42 +254,41 @@ static ListResult listBanks(RSARFile* nw, const Glob& glob)
       for (int i = 0; i < numProgs; i++) {
         rv.matches.push_back("\tProgram " + std::to_string(i) + ":");
         const auto& prog = b->programs[i];
-        for (const auto& ks : prog.keySplits) {
-          for (const auto& vs : ks.velSplits) {
-            auto sample = b->programs[i].keySplits[0].velSplits[0].sample;
-            std::ostringstream ss;
-            ss << "\t  Wave " << sample.wave.pointer
-              << " [" << int(ks.minKey) << "-" << int(ks.maxKey) << "]"
-              << " (" << int(vs.minVel) << "-" << int(vs.maxVel) << ")"
-              << " A=" << int(sample.attack)
-              << " H=" << int(sample.hold)
-              << " D=" << int(sample.decay)
-              << " S=" << int(sample.sustain)
-              << " R=" << int(sample.release);
-            rv.matches.push_back(ss.str());
-            if (war) {
-              auto wav = war->getRWAV(sample.wave.pointer);
-              if (wav) {
-                ss.str("");
-                ss << "\t\t ";
-                if (wav->format == RWAVFile::PCM8) {
-                  ss << "PCM8";
-                } else if (wav->format == RWAVFile::ADPCM) {
-                  ss << "ADPCM";
+        for (std::uint32_t r = 0; r < prog.numRegions; r++) {
+          const auto& region = b->regions[prog.firstRegion + r];
+          const auto& sample = region.sample;
+          std::ostringstream ss;
+          ss << "\t  Wave " << sample.wave.pointer
+            << " [" << int(region.minKey) << "-" << int(region.maxKey) << "]"
+            << " (" << int(region.minVel) << "-" << int(region.maxVel) << ")"
+            << " A=" << int(sample.attack)
+            << " H=" << int(sample.hold)
+            << " D=" << int(sample.decay)
+            << " S=" << int(sample.sustain)
+            << " R=" << int(sample.release);
+          rv.matches.push_back(ss.str());
+          if (war) {
+            auto wav = war->getRWAV(sample.wave.pointer);
+            if (wav) {
+              ss.str("");
+              ss << "\t\t ";
+              if (wav->format == RWAVFile::PCM8) {
+                ss << "PCM8";
+              } else if (wav->format == RWAVFile::ADPCM) {
+                ss << "ADPCM";
+              } else {
+                ss << "PCM16";
+              }
+              ss << " " << wav->sampleRate << "Hz " << wav->channels.size() << "ch ";
+              if (wav->looped) {
+                auto sd = war->getSample(sample.wave.pointer);
+                if (sd) {
+                  ss << "loop (" << sd->loopStart << "-" << sd->loopEnd <<")";
                 } else {
-                  ss << "PCM16";
-                }
-                ss << " " << wav->sampleRate << "Hz " << wav->channels.size() << "ch ";
-                if (wav->looped) {
-                  auto sd = war->getSample(sample.wave.pointer);
-                  if (sd) {
-                    ss << "loop (" << sd->loopStart << "-" << sd->loopEnd <<")";
-                  } else {
-                    ss << " (decoding error)";
-                  }
+                  ss << " (decoding error)";
                 }
-                rv.matches.push_back(ss.str());
               }
+              rv.matches.push_back(ss.str());
             }
           }
         }
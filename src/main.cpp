@@ -1,5 +1,5 @@
 #include "clefcontext.h"
-#include "riffwriter.h"
+#include "pcmsink.h"
 #include "synth/synthcontext.h"
 #include "synth/iinterpolator.h"
 #include "seq/isequence.h"
@@ -9,34 +9,173 @@
 #include "rvl/rwarfile.h"
 #include "rvl/infochunk.h"
 #include "rvl/rseqcsv.h"
-#include "riffwriter.h"
 #include "commandargs.h"
 #include "listactions.h"
+#include "samplecache.h"
+#include "voicepool.h"
+#include "threadpool.h"
+#include "trackmixer.h"
+#include "slicerenderer.h"
+#include "resampler.h"
+#include "batchrunner.h"
+#include "bankcache.h"
+#include "workingset.h"
 #include <sstream>
 #include <fstream>
 #include <filesystem>
+#include <cmath>
+#include <mutex>
 
 #include "discreteenvelope.h"
 #include "nwinstrument.h"
 
-int synth(SynthContext* context, RSEQFile* file, const std::string& filename) {
-  file->ctx->purgeSamples();
+struct RenderOptions {
+  std::uint32_t outputRate = 44100;
+  std::uint32_t internalRate = 44100;
+  ThreadPool* pool = nullptr;
+  int slices = 0;
+  double sliceOverlap = 2.0;
+  bool verifySlices = false;
+  int polyphony = 0;
+  bool adpcmDirect = false;
+  double cullLevel = NWInstrument::DEFAULT_AUDIBLE_LEVEL;
+  bool csv = false;
+  SampleCache* sampleCache = nullptr;
+};
 
+int synth(SynthContext* context, RSEQFile* file, const RenderOptions& options, const SliceRenderer::Loader& reload,
+    PcmSink* sink, std::ostream& out) {
   ISequence* seq = file->sequence();
-  for (int i = 0; i < seq->numTracks(); i++) {
-    context->addChannel(seq->getTrack(i));
+  std::unique_ptr<TrackMixer> mixer;
+  std::unique_ptr<SliceRenderer> slicer;
+  // Every render goes through TrackMixer, whatever the number of threads, so
+  // the output is the same for any --threads. A pool of 1 renders the tracks
+  // inline. Tracks are clipped to 16 bits on their own before they are
+  // summed, which only differs from mixing them in one SynthContext when a
+  // single track goes past full scale.
+  if (options.slices > 1) {
+    slicer.reset(new SliceRenderer(reload, context->sampleRate, options.slices, options.sliceOverlap, options.pool));
+  } else {
+    mixer.reset(new TrackMixer(file->ctx, seq, context->sampleRate, options.pool));
+    // A voice limit is shared by every track and has to see notes in time
+    // order.
+    mixer->setLockstep(options.polyphony > 0);
   }
 
-  RiffWriter riff(context->sampleRate, true);
-  if (!riff.open(filename)) {
-    std::cerr << "Unable to open \"" << filename << "\" for writing" << std::endl;
-    return 1;
+  std::unique_ptr<Resampler> resampler;
+  if (options.outputRate != context->sampleRate) {
+    resampler.reset(new Resampler(context->sampleRate, options.outputRate));
+  }
+
+  if (slicer) {
+    slicer->render(sink, resampler.get(), options.verifySlices);
+    if (options.verifySlices) {
+      int peak;
+      std::uint64_t differences = slicer->verify(&peak);
+      if (differences) {
+        out << "Slice verification: " << differences << " samples differ (peak difference " << peak << ")" << std::endl;
+      } else {
+        out << "Slice verification: output matches" << std::endl;
+      }
+    }
+  } else {
+    mixer->save(sink, resampler.get());
   }
-  std::cout << "Writing " << seq->duration() << " seconds to " << filename << "..." << std::endl;
-  context->save(&riff);
   return 0;
 }
 
+// A parsed sequence and its bank, ready to render. The waves it plays have
+// been decoded, and stay in the sample cache until it is destroyed.
+struct PreparedSound : public BatchRunner::Prepared {
+  ~PreparedSound() {
+    if (sampleCache) {
+      sampleCache->endSequence(cacheToken);
+    }
+  }
+
+  const RSARFile* nw = nullptr;
+  const SoundDataEntry* sound = nullptr;
+  std::unique_ptr<RSEQFile> seq;
+  std::shared_ptr<BankCache::Bank> bank;
+  SampleCache* sampleCache = nullptr;
+  std::uint64_t cacheToken = 0;
+};
+
+std::unique_ptr<PreparedSound> prepareSound(ClefContext* clef, const RSARFile* nw, BankCache* banks,
+    const SoundDataEntry& sound, const RenderOptions& options, ThreadPool* prefetchPool) {
+  std::unique_ptr<PreparedSound> prepared(new PreparedSound);
+  prepared->nw = nw;
+  prepared->sound = &sound;
+  auto seqFile = nw->getFile(sound.fileIndex, false);
+  prepared->seq.reset(NWChunk::load<RSEQFile>(seqFile, nullptr, clef));
+  if (options.csv) {
+    return prepared;
+  }
+  prepared->bank = banks->get(sound.seqData.bankIndex);
+  RBNKFile* rbnk = prepared->bank->rbnk.get();
+  RWARFile* rwar = prepared->bank->rwar.get();
+
+  // Read through a second copy of the sequence to find the waves it plays,
+  // and decode them now instead of when each one is first heard.
+  auto scanFile = nw->getFile(sound.fileIndex, false);
+  std::unique_ptr<RSEQFile> scan(NWChunk::load<RSEQFile>(scanFile, nullptr, clef));
+  scan->loadBank(nullptr, rbnk, rwar, nullptr, sound.seqData.channelPriority, sound.panCurve);
+  WorkingSet workingSet = WorkingSet::scan(scan.get());
+  prepared->sampleCache = options.sampleCache;
+  prepared->cacheToken = options.sampleCache->beginSequence();
+  workingSet.prefetch(rwar, prefetchPool);
+  return prepared;
+}
+
+int renderPrepared(ClefContext* clef, PreparedSound* prepared, const std::string& outFilename,
+    const RenderOptions& options, PcmSink* sink, std::ostream& out) {
+  const RSARFile* nw = prepared->nw;
+  const SoundDataEntry& sound = *prepared->sound;
+  RSEQFile* seq = prepared->seq.get();
+  BankCache::Bank* bank = prepared->bank.get();
+
+  SynthContext synthCtx(clef, options.internalRate, 2);
+  synthCtx.interpolator = IInterpolator::get(IInterpolator::Linear);
+
+  VoicePool voices(options.polyphony);
+  seq->loadBank(&synthCtx, bank->rbnk.get(), bank->rwar.get(), &voices, sound.seqData.channelPriority, sound.panCurve);
+  seq->setAudibility(options.cullLevel, NWInstrument::DEFAULT_AUDIBLE_HOLD);
+  auto reload = [&]() {
+    auto seqFile = nw->getFile(sound.fileIndex, false);
+    RSEQFile* copy = NWChunk::load<RSEQFile>(seqFile, nullptr, clef);
+    copy->loadBank(&synthCtx, bank->rbnk.get(), bank->rwar.get(), nullptr, sound.seqData.channelPriority, sound.panCurve);
+    copy->setAudibility(options.cullLevel, NWInstrument::DEFAULT_AUDIBLE_HOLD);
+    return copy;
+  };
+  out << "Writing " << seq->sequence()->duration() << " seconds to " << outFilename << "..." << std::endl;
+  return synth(&synthCtx, seq, options, reload, sink, out);
+}
+
+// Renders straight into a WAV file, a block at a time.
+int writePrepared(ClefContext* clef, PreparedSound* prepared, const std::string& outFilename,
+    const RenderOptions& options, std::ostream& out, std::ostream& err) {
+  RiffSink riff(options.outputRate);
+  if (!riff.open(outFilename)) {
+    err << "Unable to open \"" << outFilename << "\" for writing" << std::endl;
+    return 1;
+  }
+  int result = renderPrepared(clef, prepared, outFilename, options, &riff, out);
+  if (!riff.close()) {
+    err << "Unable to write to \"" << outFilename << "\"" << std::endl;
+    return 1;
+  }
+  return result;
+}
+
+int renderSound(ClefContext* clef, const RSARFile* nw, BankCache* banks, const SoundDataEntry& sound,
+    const std::string& outFilename, const RenderOptions& options, std::ostream& out, std::ostream& err) {
+  std::unique_ptr<PreparedSound> prepared = prepareSound(clef, nw, banks, sound, options, options.pool);
+  if (options.csv) {
+    return generateCsv(prepared->seq.get(), outFilename, err);
+  }
+  return writePrepared(clef, prepared.get(), outFilename, options, out, err);
+}
+
 int main(int argc, char** argv)
 {
   CommandArgs args({
@@ -48,6 +187,21 @@ int main(int argc, char** argv)
     { "csv",      "c", "", "Generate CSV file(s) for sequences" },
     { "seq",      "s", "pattern", "Read sequence(s) matching pattern" },
     { "verbose",  "v", "", "Include additional information" },
+    { "sample-cache-mb", "", "size", "Memory budget for decoded samples in MB (default 256, 0 = unlimited)" },
+    { "sample-cache-dir", "", "dir", "Store decoded samples in dir for reuse by later runs" },
+    { "adpcm-direct", "", "", "Play ADPCM waves without decoding them in advance (uses less memory)" },
+    { "polyphony", "p", "voices", "Limit the number of simultaneous voices (hardware: 96, default unlimited)" },
+    { "rate",     "r", "hz", "Sample rate of the output (default 44100)" },
+    { "internal-rate", "", "hz", "Synthesize at this rate and resample the mix to --rate (e.g. 32000 like the DSP)" },
+    { "threads",  "t", "count", "Render tracks on count threads (default 1, 0 = one per CPU)" },
+    { "jobs",     "j", "count", "Render count sequences at once (default 1, 0 = one per CPU)" },
+    { "slices",   "", "count", "Split each sequence into count segments of time and render them in parallel" },
+    { "slice-overlap", "", "seconds", "Extra time rendered before each segment for release tails (default 2)" },
+    { "verify-slices", "", "", "Compare sliced output against an unsliced render" },
+    { "cull-db", "", "level", "Stop voices that stay below level dBFS for 50ms (default -90, 0 = never)" },
+    { "batch",    "", "", "Keep going after a failed sequence and write each archive to its own directory" },
+    { "manifest", "", "filename", "Read input paths from filename, one per line (implies --batch)" },
+    { "journal",  "", "filename", "Record finished sequences in filename and skip them when run again (implies --batch)" },
     { "",         "",  "input", "Path(s) to the input file(s)" },
   });
 
@@ -57,7 +211,7 @@ int main(int argc, char** argv)
     return 1;
   }
 
-  if (args.hasKey("help") || !args.positional().size()) {
+  if (args.hasKey("help") || (!args.positional().size() && !args.hasKey("manifest"))) {
     std::cout << args.usageText(argv[0]) << std::endl;
     std::cerr << std::endl;
     std::cerr << "Options for --list:" << std::endl;
@@ -74,6 +228,8 @@ int main(int argc, char** argv)
     std::cerr << "When used with --synth, using \"--out-file=-\" or \"-O -\" will send the rendered output to" << std::endl;
     std::cerr << "stdout, suitable for piping into another program for playback or transcoding." << std::endl;
 #endif
+    std::cerr << std::endl;
+    std::cerr << "Inputs that are directories are searched for .brsar files and rendered with --batch." << std::endl;
     return 0;
   }
 
@@ -107,56 +263,269 @@ int main(int argc, char** argv)
     extension = ".csv";
   }
 
-  for (const std::string& filename : args.positional()) {
-    ClefContext clef;
-    SynthContext synthCtx(&clef, 44100, 2);
-    synthCtx.interpolator = IInterpolator::get(IInterpolator::Linear);
+  std::size_t cacheMB = 256;
+  if (args.hasKey("sample-cache-mb")) {
+    try {
+      cacheMB = std::stoul(args.getString("sample-cache-mb"));
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --sample-cache-mb" << std::endl;
+      return 1;
+    }
+  }
 
-    std::ifstream is(filename, std::ios::in | std::ios::binary);
-    std::unique_ptr<RSARFile> nw(NWChunk::load<RSARFile>(is, nullptr, &clef));
-    bool didSomething = false;
-    for (auto sound : nw->info->soundDataEntries) {
-      if (sound.soundType != SoundType::SEQ || !glob.match(sound.name)) {
-        continue;
+  int polyphony = 0;
+  if (args.hasKey("polyphony")) {
+    try {
+      polyphony = std::stoi(args.getString("polyphony"));
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --polyphony" << std::endl;
+      return 1;
+    }
+  }
+
+  int threads = 1;
+  if (args.hasKey("threads")) {
+    try {
+      threads = std::stoi(args.getString("threads"));
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --threads" << std::endl;
+      return 1;
+    }
+    if (threads <= 0) {
+      threads = ThreadPool::hardwareThreads();
+    }
+  }
+  ThreadPool pool(threads);
+
+  int jobs = 1;
+  if (args.hasKey("jobs")) {
+    try {
+      jobs = std::stoi(args.getString("jobs"));
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --jobs" << std::endl;
+      return 1;
+    }
+    if (jobs <= 0) {
+      jobs = ThreadPool::hardwareThreads();
+    }
+  }
+  ThreadPool jobPool(jobs);
+  // Sequences rendered side by side don't split their tracks further, since
+  // the job pool already keeps every thread busy.
+  ThreadPool inlinePool(1);
+
+  RenderOptions renderOptions;
+  renderOptions.pool = &pool;
+  if (args.hasKey("rate")) {
+    try {
+      renderOptions.outputRate = std::stoul(args.getString("rate"));
+    } catch (...) {
+      renderOptions.outputRate = 0;
+    }
+    if (!renderOptions.outputRate || renderOptions.outputRate > 384000) {
+      std::cerr << argv[0] << ": invalid value for --rate" << std::endl;
+      return 1;
+    }
+  }
+  std::uint32_t internalRate = 0;
+  if (args.hasKey("internal-rate")) {
+    try {
+      internalRate = std::stoul(args.getString("internal-rate"));
+    } catch (...) {
+      internalRate = 0;
+    }
+    if (!internalRate || internalRate > 384000) {
+      std::cerr << argv[0] << ": invalid value for --internal-rate" << std::endl;
+      return 1;
+    }
+  }
+  renderOptions.internalRate = internalRate ? internalRate : renderOptions.outputRate;
+  renderOptions.polyphony = polyphony;
+  renderOptions.adpcmDirect = args.hasKey("adpcm-direct");
+  renderOptions.csv = args.hasKey("csv");
+  renderOptions.verifySlices = args.hasKey("verify-slices");
+  if (args.hasKey("slices")) {
+    try {
+      renderOptions.slices = std::stoi(args.getString("slices"));
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --slices" << std::endl;
+      return 1;
+    }
+  }
+  if (args.hasKey("slice-overlap")) {
+    try {
+      renderOptions.sliceOverlap = std::stod(args.getString("slice-overlap"));
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --slice-overlap" << std::endl;
+      return 1;
+    }
+  }
+
+  if (polyphony > 0 && (threads > 1 || renderOptions.slices > 1)) {
+    std::cerr << argv[0] << ": --polyphony cannot be used with --threads or --slices" << std::endl;
+    return 1;
+  }
+
+  if (args.hasKey("cull-db")) {
+    try {
+      double cullDB = std::stod(args.getString("cull-db"));
+      renderOptions.cullLevel = cullDB < 0 ? std::pow(10.0, cullDB / 20.0) : 0;
+    } catch (...) {
+      std::cerr << argv[0] << ": invalid value for --cull-db" << std::endl;
+      return 1;
+    }
+  }
+
+  // The context and sample cache are shared by all inputs, and by all jobs,
+  // so that waves used by more than one sequence are only decoded once.
+  ClefContext clef;
+  SampleCache sampleCache(cacheMB << 20);
+  if (args.hasKey("sample-cache-dir")) {
+    std::unique_ptr<PcmDiskCache> disk(new PcmDiskCache(args.getString("sample-cache-dir")));
+    if (!disk->isValid()) {
+      std::cerr << argv[0] << ": unable to use \"" << disk->path() << "\" as a sample cache directory" << std::endl;
+      return 1;
+    }
+    sampleCache.setDiskCache(std::move(disk));
+  }
+
+  // Progress goes to stderr when the audio itself is going to stdout.
+  std::ostream& log = outPath == "/dev/stdout" ? std::cerr : std::cout;
+
+  renderOptions.sampleCache = &sampleCache;
+  RenderOptions jobOptions = renderOptions;
+  if (jobs > 1) {
+    jobOptions.pool = &inlinePool;
+  }
+
+  bool batch = args.hasKey("batch") || args.hasKey("manifest") || args.hasKey("journal");
+  for (const std::string& filename : args.positional()) {
+    if (std::filesystem::is_directory(filename)) {
+      batch = true;
+    }
+  }
+  if (batch) {
+    if (singleFile) {
+      std::cerr << argv[0] << ": --out-file cannot be used in batch mode" << std::endl;
+      return 1;
+    }
+    auto prepare = [&](const RSARFile* nw, BankCache* banks, const SoundDataEntry& sound) {
+      return std::unique_ptr<BatchRunner::Prepared>(prepareSound(&clef, nw, banks, sound, jobOptions, nullptr));
+    };
+    auto render = [&](BatchRunner::Prepared* prepared, const std::string& outFilename,
+        std::ostream& out, std::ostream& err) {
+      PreparedSound* sound = static_cast<PreparedSound*>(prepared);
+      if (jobOptions.csv) {
+        // Reported through err so that the message stays with the rest of
+        // this sequence's output.
+        return generateCsv(sound->seq.get(), outFilename, err);
       }
-      auto seqFile = nw->getFile(sound.fileIndex, false);
-      RSEQFile* seq = NWChunk::load<RSEQFile>(seqFile, nullptr, &clef);
-
-      std::unique_ptr<RBNKFile> bank;
-      std::unique_ptr<RWARFile> war;
-
-      int err;
-      std::string outFilename = outPath;
-      if (singleFile) {
-        if (didSomething) {
-          std::cerr << "Can only process one sequence when using --out-file" << std::endl;
-          return 1;
-        }
-      } else {
-        outFilename += "/" + sound.name + extension;
+      return writePrepared(&clef, sound, outFilename, jobOptions, out, err);
+    };
+    BatchRunner runner(&clef, &jobPool, prepare, render);
+    runner.setBankOptions(&sampleCache, renderOptions.adpcmDirect);
+    runner.setFilter(&glob);
+    runner.setOutput(outPath, extension);
+    std::string error;
+    if (args.hasKey("manifest") && !runner.addManifest(args.getString("manifest"), error)) {
+      std::cerr << argv[0] << ": " << error << std::endl;
+      return 1;
+    }
+    for (const std::string& filename : args.positional()) {
+      if (!runner.addInput(filename, error)) {
+        std::cerr << argv[0] << ": " << error << std::endl;
+        return 1;
       }
-      if (args.hasKey("csv")) {
-        err = generateCsv(seq, outFilename);
-      } else {
-        auto bankEntry = nw->info->soundBankEntries[sound.seqData.bankIndex];
-        auto bankFile = nw->getFile(bankEntry.fileIndex, false);
-        bank.reset(NWChunk::load<RBNKFile>(bankFile, nullptr, &clef));
-        auto audioFile = nw->getFile(bankEntry.fileIndex, true);
-        war.reset(NWChunk::load<RWARFile>(audioFile, nullptr, &clef));
-        seq->loadBank(&synthCtx, bank.get(), war.get());
-        err = synth(&synthCtx, seq, outFilename);
+    }
+    std::unique_ptr<BatchJournal> journal;
+    if (args.hasKey("journal")) {
+      journal.reset(new BatchJournal(args.getString("journal")));
+      if (!journal->isValid()) {
+        std::cerr << argv[0] << ": unable to open journal \"" << args.getString("journal") << "\"" << std::endl;
+        return 1;
       }
-      if (err) {
-        return err;
+      runner.setJournal(journal.get());
+    }
+    runner.run();
+    std::cout << "Batch: " << runner.numInputs() << " archives, " << runner.rendered << " rendered, "
+      << runner.skipped << " skipped, " << runner.failed << " failed" << std::endl;
+    return runner.failed ? 1 : 0;
+  }
+
+  for (const std::string& filename : args.positional()) {
+    std::ifstream is(filename, std::ios::in | std::ios::binary);
+    std::unique_ptr<RSARFile> nw(NWChunk::load<RSARFile>(is, nullptr, &clef));
+    clef.purgeSamples();
+    BankCache banks(nw.get(), &clef, &sampleCache, renderOptions.adpcmDirect);
+
+    std::vector<const SoundDataEntry*> sounds;
+    for (const auto& sound : nw->info->soundDataEntries) {
+      if (sound.soundType == SoundType::SEQ && glob.match(sound.name)) {
+        sounds.push_back(&sound);
       }
-      didSomething = true;
     }
-    if (!didSomething) {
+    if (sounds.empty()) {
       if (args.hasKey("filter")) {
         std::cerr << "Nothing found matching \"" << args.getString("filter") << "\" in " << filename << std::endl;
       } else {
         std::cerr << "No sequences found in " << filename << std::endl;
       }
+      continue;
+    }
+    bool tooMany = singleFile && sounds.size() > 1;
+    if (tooMany) {
+      sounds.resize(1);
+    }
+
+    auto outFilename = [&](const SoundDataEntry* sound) {
+      return singleFile ? outPath : outPath + "/" + sound->name + extension;
+    };
+
+    if (jobs <= 1) {
+      for (const SoundDataEntry* sound : sounds) {
+        int err = renderSound(&clef, nw.get(), &banks, *sound, outFilename(sound), jobOptions, log, std::cerr);
+        if (err) {
+          return err;
+        }
+      }
+    } else {
+      // Each job buffers its messages, and they are printed in the order of
+      // the sequences as soon as every earlier job has finished.
+      struct Job {
+        std::ostringstream out, err;
+        int result = 0;
+        bool done = false;
+      };
+      std::vector<Job> results(sounds.size());
+      std::mutex printMutex;
+      std::size_t nextToPrint = 0;
+      jobPool.run(sounds.size(), [&](int i) {
+        Job& job = results[i];
+        job.result = renderSound(&clef, nw.get(), &banks, *sounds[i], outFilename(sounds[i]), jobOptions, job.out, job.err);
+        std::lock_guard<std::mutex> lock(printMutex);
+        job.done = true;
+        while (nextToPrint < results.size() && results[nextToPrint].done) {
+          log << results[nextToPrint].out.str() << std::flush;
+          std::cerr << results[nextToPrint].err.str() << std::flush;
+          ++nextToPrint;
+        }
+      });
+      for (const Job& job : results) {
+        if (job.result) {
+          return job.result;
+        }
+      }
+    }
+    if (tooMany) {
+      std::cerr << "Can only process one sequence when using --out-file" << std::endl;
+      return 1;
+    }
+  }
+  if (!args.hasKey("csv") && (sampleCache.hits || sampleCache.misses)) {
+    log << "Sample cache: " << sampleCache.hits << " hits, " << sampleCache.misses << " misses, "
+      << sampleCache.evictions << " evictions, " << (sampleCache.residentBytes() >> 10) << " KB resident" << std::endl;
+    if (sampleCache.diskCache()) {
+      log << "Sample disk cache: " << sampleCache.diskHits << " loaded, " << sampleCache.diskWrites << " written" << std::endl;
     }
   }
   return 0;
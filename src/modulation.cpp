@@ -0,0 +1,83 @@
+#include "modulation.h"
+#include <cmath>
+
+namespace {
+
+// M_PI isn't part of standard C++, and MSVC only defines it on request.
+constexpr double PI = 3.14159265358979323846;
+
+struct WaveformTables
+{
+  WaveformTables()
+  {
+    constexpr int size = Modulation::TABLE_SIZE;
+    std::uint32_t seed = 0x2F6B3D47;
+    for (int i = 0; i < size; i++) {
+      double x = double(i) / size;
+      curves[LfoParams::Sine][i] = std::sin(2 * PI * x);
+      curves[LfoParams::Triangle][i] = x < 0.25 ? 4 * x : x < 0.75 ? 2 - 4 * x : 4 * x - 4;
+      curves[LfoParams::Saw][i] = 2 * x - 1;
+      curves[LfoParams::Square][i] = x < 0.5 ? 1 : -1;
+      // The random curve holds a new value for each 1/16 of a cycle.
+      if (i % (size / 16) == 0) {
+        seed = seed * 1103515245 + 12345;
+      }
+      curves[LfoParams::Random][i] = double((seed >> 16) & 0x7FFF) / 0x3FFF - 1.0;
+    }
+  }
+
+  float curves[LfoParams::NumCurves][Modulation::TABLE_SIZE];
+};
+
+const WaveformTables tables;
+
+}
+
+double Modulation::waveform(int curve, double phase)
+{
+  if (curve < 0 || curve >= LfoParams::NumCurves) {
+    curve = LfoParams::Sine;
+  }
+  int index = int((phase - std::floor(phase)) * TABLE_SIZE) & (TABLE_SIZE - 1);
+  return tables.curves[curve][index];
+}
+
+bool Modulation::isActive() const
+{
+  if (sweepPitch != 0) {
+    return true;
+  }
+  for (const LfoParams& params : lfo) {
+    if (params.isActive()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Modulation::evaluate(double time, double* pitch, double* volume, double* pan) const
+{
+  *pitch = 0;
+  *volume = 0;
+  *pan = 0;
+  if (sweepPitch != 0 && time < sweepTime) {
+    *pitch += sweepPitch * (1.0 - time / sweepTime);
+  }
+  for (const LfoParams& params : lfo) {
+    if (!params.isActive() || time < params.delay) {
+      continue;
+    }
+    double value = waveform(params.curve, params.phase + (time - params.delay) * params.speed) * params.depth * params.range;
+    switch (params.target) {
+    case LfoParams::Pitch:
+      *pitch += value;
+      break;
+    case LfoParams::Volume:
+      *volume += value * 6.0;
+      break;
+    case LfoParams::Pan:
+      *pan += value / 2;
+      break;
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef NW_MODULATION_H
+#define NW_MODULATION_H
+
+#include <cstdint>
+
+// Settings for one of the four LFOs that a track can control.
+struct LfoParams
+{
+  enum Target {
+    Pitch = 0,
+    Volume = 1,
+    Pan = 2,
+  };
+
+  enum Curve {
+    Sine = 0,
+    Triangle = 1,
+    Saw = 2,
+    Square = 3,
+    Random = 4,
+    NumCurves
+  };
+
+  double depth = 0;      // 0 to ~1
+  double speed = 6.25;   // Hz
+  int target = Pitch;
+  int range = 1;
+  double delay = 0;      // seconds
+  int curve = Sine;
+  double phase = 0;      // fraction of a cycle
+
+  inline bool isActive() const { return depth > 0 && range != 0; }
+};
+
+// Modulation applied to a single voice: the track's LFOs at the time the note
+// started, plus a pitch sweep used for portamento and the Sweep command. This
+// is evaluated once per control period, so it adds nothing to the per-sample
+// cost of a voice.
+struct Modulation
+{
+  LfoParams lfo[4];
+  double sweepPitch = 0; // semitones away from the note at the start
+  double sweepTime = 0;  // seconds to reach the note
+
+  bool isActive() const;
+
+  // Evaluates the modulation at the specified time since the start of the
+  // note. Pitch is returned in semitones, volume in dB, and pan as an offset
+  // from the voice's pan position.
+  void evaluate(double time, double* pitch, double* volume, double* pan) const;
+
+  // Samples a waveform from a precomputed table. The phase is in cycles.
+  static double waveform(int curve, double phase);
+
+  static constexpr int TABLE_BITS = 8;
+  static constexpr int TABLE_SIZE = 1 << TABLE_BITS;
+};
+
+#endif
@@ -4,8 +4,13 @@
 #include "utility.h"
 #include "codec/sampledata.h"
 #include "synth/sampler.h"
+#include "nwvoice.h"
+#include "voicepool.h"
+#include "panlaw.h"
+#include "workingset.h"
 #include "synth/synthcontext.h"
 #include <iomanip>
+#include <cmath>
 
 #define PARAM(name) ((name >= 0) ? name : info->name / 127.0)
 static constexpr double SDAT_TICK = 64.0 * 2728.0 / 33513982;
@@ -13,11 +18,6 @@ static constexpr double RSEQ_TICK = 1.0 / 192.0;
 static constexpr double SDAT_RES = 723;
 static constexpr double SDAT_SCALE = SDAT_RES * 128;
 
-enum ParamIndexes {
-  I_SampleID,
-  F_PitchBend = 0,
-};
-
 NWInstrument::TimeParam::TimeParam(double value)
 : startLevel(value), startTime(0), endLevel(value), endTime(0)
 {
@@ -43,12 +43,14 @@ double NWInstrument::TimeParam::valueAt(double time) const
 }
 
 NWInstrument::NWInstrument()
-: synth(nullptr), bank(nullptr), war(nullptr), lastPlaybackID(0), lastPlaybackEnd(-1)
+: priority(64), synth(nullptr), bank(nullptr), war(nullptr), voices(nullptr), channelPriority(64), panLaw(nullptr),
+  lastPlaybackID(0), lastPlaybackEnd(-1)
 {
   // initializers only
 }
 
-NWInstrument::NWInstrument(SynthContext* synth, const RBNKFile* bank, const RWARFile* war, int program)
+NWInstrument::NWInstrument(SynthContext* synth, const RBNKFile* bank, const RWARFile* war, int program, VoicePool* voices,
+    int channelPriority, const PanLaw* panLaw)
 : program(program),
   volume(-1),
   pan(-1),
@@ -59,9 +61,13 @@ NWInstrument::NWInstrument(SynthContext* synth, const RBNKFile* bank, const RWAR
   sustain(-1),
   release(-1),
   tie(false),
+  priority(64),
   synth(synth),
   bank(bank),
   war(war),
+  voices(voices),
+  channelPriority(channelPriority),
+  panLaw(panLaw),
   lastPlaybackID(0),
   lastPlaybackEnd(-1)
 {
@@ -71,35 +77,97 @@ NWInstrument::NWInstrument(SynthContext* synth, const RBNKFile* bank, const RWAR
 SequenceEvent* NWInstrument::makeEvent(double timestamp, int noteNumber, int velocity, double duration)
 {
   auto info = bank->getSample(program, noteNumber, velocity);
+
+  if (workingSet) {
+    // A tied note carries on with the voice that is already playing.
+    if (info && (!tie || lastPlaybackEnd < timestamp)) {
+      workingSet->add(program, bank->findRegion(program, noteNumber, velocity), info->wave.pointer);
+    }
+    if (info && velocity > 0) {
+      lastPlaybackEnd = duration > 0 ? timestamp + duration + .001 : HUGE_VAL;
+    }
+    SequenceEvent* event = new WorkingSetEvent;
+    event->timestamp = timestamp;
+    return event;
+  }
+
   if (!info) {
     return nullptr;
   }
 
-  SampleData* sample = bank->ctx->getSample(info->wave.pointer);
-  if (!sample) {
-    sample = war->getSample(info->wave.pointer);
-    if (!sample) {
-      return nullptr;
-    }
+  if (!war->playsDirect(info->wave.pointer) && !war->getSample(info->wave.pointer)) {
+    return nullptr;
   }
 
   if (tie && lastPlaybackEnd >= timestamp) {
     NoteUpdateEvent* event = new NoteUpdateEvent(lastPlaybackID);
     event->params[Sampler::Pitch] = semitonesToFactor(noteNumber - info->baseNote);
-    event->params[AudioNode::Gain] = velocity / 127.0;
+    event->params[NWVoice::Volume] = velocity / 127.0;
     event->newDuration = duration;
     event->timestamp = timestamp;
     lastPlaybackEnd = timestamp + duration + .001;
     return event;
   }
 
-  InstrumentNoteEvent* event = new InstrumentNoteEvent;
+  NoteParams note;
+  buildNote(info, timestamp, noteNumber, velocity, duration, note);
+  NWNoteEvent* event = new NWNoteEvent;
   event->timestamp = timestamp;
   event->duration = duration;
-  event->pitch = semitonesToFactor(noteNumber - info->baseNote);
-  event->intParams.push_back(sample->sampleID);
-  event->floatParams.push_back(semitonesToFactor(pitchBend.valueAt(timestamp)));
-  event->volume = (velocity / 127.0);
+  event->pitch = note.pitch;
+  event->intParams.push_back(note.wave);
+  event->intParams.push_back(note.priority);
+  event->floatParams.push_back(note.pitchBend);
+  event->volume = note.volume;
+  event->pan = note.pan;
+  event->regionPan = note.regionPan;
+  event->modulation = note.modulation;
+  event->setEnvelope(note.attack, note.hold, note.decay, note.sustain, note.release);
+
+  if (velocity > 0) {
+    lastPlaybackID = event->playbackID;
+    if (duration > 0) {
+      lastPlaybackEnd = timestamp + duration + .001;
+    } else {
+      lastPlaybackEnd = HUGE_VAL;
+    }
+  }
+
+  return event;
+}
+
+void NWInstrument::buildNote(const RBNKFile::Sample* info, double timestamp, int noteNumber, int velocity, double duration,
+    NoteParams& note)
+{
+  note.wave = info->wave.pointer;
+  // Both default to 64, so the sum is centered on 64 rather than saturating
+  // at 127 for every note that doesn't change them.
+  note.priority = clamp(channelPriority + priority - 64, 0, 127);
+  note.pitch = semitonesToFactor(noteNumber - info->baseNote);
+  note.pitchBend = semitonesToFactor(pitchBend.valueAt(timestamp));
+  note.volume = velocity / 127.0;
+  double trackPan = pan.valueAt(timestamp);
+  note.pan = trackPan < 0 ? 0.5 : trackPan;
+  note.regionPan = info->pan;
+
+  note.modulation = modulation;
+  double sweepPitch = sweep;
+  if (portamento && portaKey >= 0) {
+    sweepPitch += portaKey - noteNumber;
+  }
+  if (sweepPitch != 0) {
+    // Like the original driver, a porta time of 0 sweeps over the whole note
+    // and otherwise the sweep takes longer for wider intervals.
+    note.modulation.sweepPitch = sweepPitch;
+    if (portaTime == 0) {
+      note.modulation.sweepTime = duration;
+    } else {
+      note.modulation.sweepTime = (portaTime * portaTime * std::fabs(sweepPitch) / 2048) * NWVoice::CONTROL_PERIOD;
+    }
+  }
+  if (portamento) {
+    portaKey = noteNumber;
+  }
 
   double a = attack < 0 ? attackValue(info->attack) : attack;
   double h = hold < 0 ? holdValue(info->hold) : hold;
@@ -111,18 +179,21 @@ SequenceEvent* NWInstrument::makeEvent(double timestamp, int noteNumber, int vel
   if (d < 0) d = decayValue(0);
   if (s < 0) s = sustainValue(1);
   if (r < 0) r = releaseValue(0);
-  event->setEnvelope(a, h, d, s, r);
+  note.attack = a;
+  note.hold = h;
+  note.decay = d;
+  note.sustain = s;
+  note.release = r;
+}
 
-  if (velocity > 0) {
-    lastPlaybackID = event->playbackID;
-    if (duration > 0) {
-      lastPlaybackEnd = timestamp + duration + .001;
-    } else {
-      lastPlaybackEnd = HUGE_VAL;
-    }
+bool NWInstrument::buildNote(double timestamp, int noteNumber, int velocity, double duration, NoteParams& note)
+{
+  auto info = bank->getSample(program, noteNumber, velocity);
+  if (!info) {
+    return false;
   }
-
-  return event;
+  buildNote(info, timestamp, noteNumber, velocity, duration, note);
+  return true;
 }
 
 Channel::Note* NWInstrument::noteEvent(Channel* channel, std::shared_ptr<BaseNoteEvent> event)
@@ -132,43 +203,65 @@ Channel::Note* NWInstrument::noteEvent(Channel* channel, std::shared_ptr<BaseNot
     return DefaultInstrument::noteEvent(channel, event);
   }
 
-  SampleData* sampleData = bank->ctx->getSample(noteEvent->intParams[I_SampleID]);
+  int waveIndex = noteEvent->intParams[I_SampleID];
   double pitchBend = noteEvent->floatParams[F_PitchBend];
   double duration = event->duration;
 
-  Sampler* samp = new Sampler(channel->ctx, sampleData, noteEvent->pitch, pitchBend);
-  samp->param(AudioNode::Gain)->setConstant(noteEvent->volume);
-  samp->param(AudioNode::Pan)->setConstant(noteEvent->pan);
-  if (!duration) {
-    duration = sampleData->duration();
+  int attack = int(event->attack);
+  DiscreteEnvelope::Step startGain = startStep(attack);
+  NWVoice* voice = NWVoice::create(channel->ctx, war, waveIndex, noteEvent->pitch, pitchBend, startGain.nextVolume, startGain.userData);
+  if (!voice) {
+    return nullptr;
   }
 
-  int attack = int(event->attack);
-  DiscreteEnvelope::Step startGain = attackStep(attack, 0, -SDAT_SCALE);
-  DiscreteEnvelope* env = new DiscreteEnvelope(channel->ctx, startGain.nextVolume, startGain.userData);
+  // Only steal a voice once the note is known to be playable.
+  int voiceSlot = -1;
+  if (voices && voices->isLimited()) {
+    voiceSlot = voices->acquire(noteEvent->intParams[I_Priority]);
+    if (voiceSlot < 0) {
+      delete voice;
+      return nullptr;
+    }
+  }
+  if (auto nwEvent = std::dynamic_pointer_cast<NWNoteEvent>(event)) {
+    voice->setModulation(nwEvent->modulation);
+    if (panLaw) {
+      voice->setPanLaw(panLaw, nwEvent->regionPan - PanLaw::CENTER);
+    }
+  }
+  voice->param(NWVoice::Volume)->setConstant(noteEvent->volume);
+  voice->param(NWVoice::Balance)->setConstant(noteEvent->pan);
+  if (!duration) {
+    duration = voice->duration();
+  }
 
   if (event->attack < 127) {
-    env->addPhase([attack](double last, double user) { return attackStep(attack, last, user); });
+    voice->addPhase([attack](double last, double user) { return attackStep(attack, last, user); });
   }
 
   if (event->hold > 0) {
     double hold = event->hold;
-    env->addPhase([hold](double last, double user) { return holdStep(hold, last, user); });
+    voice->addPhase([hold](double last, double user) { return holdStep(hold, last, user); });
   }
 
   double sustain = event->sustain;
   if (event->sustain < 127) {
     double decay = event->decay;
-    env->addPhase([decay, sustain](double last, double user) { return decayStep(decay, sustain, last, user); });
+    voice->addPhase([decay, sustain](double last, double user) { return decayStep(decay, sustain, last, user); });
   }
-  env->addPhase(sustainStep);
+  voice->addPhase(sustainStep);
 
   double release = event->release;
-  env->setReleasePhase([release](double last, double user) { return decayStep(release, -SDAT_SCALE, last, user); });
+  voice->setReleasePhase([release](double last, double user) { return releaseStep(release, last, user); });
 
-  env->connect(std::shared_ptr<AudioNode>(samp), true);
+  if (audibleLevel > 0) {
+    voice->setAudibilityThreshold(audibleLevel, audibleHold, event->attack < 127 ? 1 : 0);
+  }
+  if (voiceSlot >= 0) {
+    voices->assign(voiceSlot, voice);
+  }
 
-  return channel->allocNote(event, env, duration);
+  return channel->allocNote(event, voice, duration);
 }
 
 double NWInstrument::scaleVolume(int v)
@@ -209,6 +302,16 @@ DiscreteEnvelope::Step NWInstrument::sustainStep(double last, double user)
   return { last, HUGE_VAL, false, user };
 }
 
+DiscreteEnvelope::Step NWInstrument::startStep(int attack)
+{
+  return attackStep(attack, 0, -SDAT_SCALE);
+}
+
+DiscreteEnvelope::Step NWInstrument::releaseStep(double release, double last, double user)
+{
+  return decayStep(release, -SDAT_SCALE, last, user);
+}
+
 double NWInstrument::attackValue(std::int8_t v)
 {
   constexpr std::uint8_t lut[] = {
@@ -5,13 +5,26 @@
 #include "seq/sequenceevent.h"
 #include "rvl/rbnkfile.h"
 #include "discreteenvelope.h"
+#include "modulation.h"
 class RWARFile;
 class SynthContext;
+class VoicePool;
+class PanLaw;
+class WorkingSet;
+
+// A note event that carries the track's modulation settings at the time the
+// note was read.
+struct NWNoteEvent : public InstrumentNoteEvent
+{
+  Modulation modulation;
+  int regionPan = 64;
+};
 
 struct NWInstrument : public DefaultInstrument
 {
   NWInstrument();
-  NWInstrument(SynthContext* synth, const RBNKFile* bank, const RWARFile* war, int program = 0);
+  NWInstrument(SynthContext* synth, const RBNKFile* bank, const RWARFile* war, int program = 0, VoicePool* voices = nullptr,
+      int channelPriority = 64, const PanLaw* panLaw = nullptr);
   NWInstrument(const NWInstrument& other) = default;
   NWInstrument& operator=(const NWInstrument& other) = default;
   NWInstrument& operator=(NWInstrument&& other) = default;
@@ -29,6 +42,13 @@ struct NWInstrument : public DefaultInstrument
     double endTime;
   };
 
+  // Positions of the parameters in the note events built by makeEvent().
+  enum ParamIndexes {
+    I_SampleID,
+    I_Priority,
+    F_PitchBend = 0,
+  };
+
   int trackIndex = 0;
   int program;
   double volume;
@@ -36,8 +56,39 @@ struct NWInstrument : public DefaultInstrument
   TimeParam pitchBend;
   double attack, hold, decay, sustain, release;
   bool tie;
+  int priority;
+
+  Modulation modulation;
+  bool portamento = false;
+  int portaKey = -1;
+  int portaTime = 0;
+  double sweep = 0; // semitones
+
+  // When set, makeEvent() only records the region and wave the note would
+  // play, and returns a WorkingSetEvent in place of the note. See
+  // WorkingSet::scan().
+  WorkingSet* workingSet = nullptr;
+
+  // The parameters of a note as makeEvent() puts them in an NWNoteEvent. The
+  // envelope is in the units of attackValue() and friends.
+  struct NoteParams {
+    int wave;
+    int priority;
+    double pitch;
+    double pitchBend;
+    double volume;
+    double pan;
+    int regionPan;
+    double attack, hold, decay, sustain, release;
+    Modulation modulation;
+  };
 
   SequenceEvent* makeEvent(double timestamp, int noteNumber, int velocity, double duration);
+
+  // Works out a note the way makeEvent() does, without building an event or
+  // decoding its wave, so it allocates nothing. Ties are not followed.
+  // Returns false if the bank has nothing to play for the note.
+  bool buildNote(double timestamp, int noteNumber, int velocity, double duration, NoteParams& note);
   virtual Channel::Note* noteEvent(Channel* channel, std::shared_ptr<BaseNoteEvent> event) override;
   //virtual void channelEvent(Channel* channel, std::shared_ptr<ChannelEvent> event);
   //virtual void modulatorEvent(Channel* channel, std::shared_ptr<ModulatorEvent> event);
@@ -48,6 +99,9 @@ struct NWInstrument : public DefaultInstrument
   static DiscreteEnvelope::Step holdStep(double hold, double last, double user);
   static DiscreteEnvelope::Step decayStep(double decay, double sustain, double last, double user);
   static DiscreteEnvelope::Step sustainStep(double last, double user);
+  // The level a voice starts at, before its attack phase.
+  static DiscreteEnvelope::Step startStep(int attack);
+  static DiscreteEnvelope::Step releaseStep(double release, double last, double user);
 
   static double attackValue(std::int8_t v);
   static double holdValue(std::int8_t v);
@@ -56,11 +110,25 @@ struct NWInstrument : public DefaultInstrument
   static double releaseValue(std::int8_t v);
 
   static double scaleVolume(std::int32_t v);
+
+  static constexpr double DEFAULT_AUDIBLE_LEVEL = 0.0000316; // -90 dBFS
+  static constexpr double DEFAULT_AUDIBLE_HOLD = 0.05;
+
+  // Voices whose envelope * velocity * LFO volume stays below audibleLevel
+  // for audibleHold seconds after the attack are retired early. Set
+  // audibleLevel to 0 to disable.
+  double audibleLevel = DEFAULT_AUDIBLE_LEVEL;
+  double audibleHold = DEFAULT_AUDIBLE_HOLD;
 private:
+  void buildNote(const RBNKFile::Sample* info, double timestamp, int noteNumber, int velocity, double duration,
+      NoteParams& note);
 
   SynthContext* synth;
   const RBNKFile* bank;
   const RWARFile* war;
+  VoicePool* voices;
+  int channelPriority;
+  const PanLaw* panLaw;
   std::uint64_t lastPlaybackID;
   double lastPlaybackEnd;
   //BaseOscillator* makeLFO(const LFO& lfo) const;
@@ -0,0 +1,562 @@
+#include "nwplayer.h"
+#include "nwinstrument.h"
+#include "nwvoice.h"
+#include "panlaw.h"
+#include "rvl/rseqfile.h"
+#include "rvl/rbnkfile.h"
+#include "rvl/rwarfile.h"
+#include "seq/isequence.h"
+#include "seq/itrack.h"
+#include "seq/sequenceevent.h"
+#include "synth/sampler.h"
+#include "utility.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+NWPlayer::NWPlayer(double sampleRate, int maxVoices)
+: rate(sampleRate), panLaw(nullptr), nextEvent(0), frame(0), endFrame(0), nextSerial(0),
+  cullLevel(NWInstrument::DEFAULT_AUDIBLE_LEVEL), cullHold(NWInstrument::DEFAULT_AUDIBLE_HOLD), live(false)
+{
+  voices.resize(maxVoices > 0 ? maxVoices : 1);
+  for (Voice& voice : voices) {
+    voice.active = false;
+  }
+}
+
+bool NWPlayer::prepare(RSEQFile* seq, const RWARFile* war, PanCurve panCurve)
+{
+  live = false;
+  channels.clear();
+  panLaw = PanLaw::get(panCurve);
+  notes.clear();
+  events.clear();
+  sources.assign(war->numSamples(), PcmReader());
+
+  ISequence* sequence = seq->sequence();
+  int numTracks = sequence->numTracks();
+  trackGain.assign(numTracks, 1.0);
+  std::unordered_map<std::uint64_t, int> notesByID;
+  for (int t = 0; t < numTracks; t++) {
+    ITrack* track = sequence->getTrack(t);
+    while (auto event = track->nextEvent()) {
+      std::int64_t at = std::llround(event->timestamp * rate);
+      if (at < 0) {
+        at = 0;
+      }
+      if (auto noteEvent = std::dynamic_pointer_cast<NWNoteEvent>(event)) {
+        int wave = noteEvent->intParams[NWInstrument::I_SampleID];
+        if (wave < 0 || wave >= sources.size()) {
+          continue;
+        }
+        PcmReader& source = sources[wave];
+        if (!source.numChannels) {
+          const SampleData* sample = war->getSample(wave);
+          if (!sample || sample->channels.empty() || sample->channels[0].empty()) {
+            continue;
+          }
+          source = PcmReader(sample);
+        }
+        Note note;
+        note.startFrame = at;
+        double duration = noteEvent->duration;
+        if (!duration && source.loopStart < 0) {
+          duration = source.length / source.sampleRate;
+        }
+        // A looped wave without a length holds until the end of the
+        // sequence, which isn't known until every track has been read.
+        note.endFrame = duration ? at + std::llround(duration * rate) : INT64_MAX;
+        note.track = t;
+        note.key = -1;
+        note.wave = wave;
+        note.priority = noteEvent->intParams[NWInstrument::I_Priority];
+        note.pitch = noteEvent->pitch;
+        note.pitchBend = noteEvent->floatParams[NWInstrument::F_PitchBend];
+        note.volume = noteEvent->volume;
+        note.pan = noteEvent->pan;
+        note.panOffset = noteEvent->regionPan - PanLaw::CENTER;
+        note.attack = int(noteEvent->attack);
+        note.hold = noteEvent->hold;
+        note.decay = noteEvent->decay;
+        note.sustain = noteEvent->sustain;
+        note.release = noteEvent->release;
+        note.modulation = noteEvent->modulation;
+        notesByID[noteEvent->playbackID] = notes.size();
+        events.push_back({ at, Event::NoteOn, int(notes.size()), 0, 0, 0 });
+        notes.push_back(note);
+      } else if (auto update = std::dynamic_pointer_cast<NoteUpdateEvent>(event)) {
+        auto iter = notesByID.find(update->playbackID);
+        if (iter == notesByID.end()) {
+          continue;
+        }
+        auto pitch = update->params.find(Sampler::Pitch);
+        auto gain = update->params.find(NWVoice::Volume);
+        events.push_back({
+          at,
+          Event::NoteUpdate,
+          iter->second,
+          pitch == update->params.end() ? -1.0 : pitch->second,
+          gain == update->params.end() ? -1.0 : gain->second,
+          at + std::llround(update->newDuration * rate),
+        });
+      } else if (auto channel = std::dynamic_pointer_cast<ChannelEvent>(event)) {
+        if (channel->param == AudioNode::Gain) {
+          events.push_back({ at, Event::TrackGain, t, channel->value, 0, 0 });
+        }
+      } else if (auto mod = std::dynamic_pointer_cast<ModulatorEvent>(event)) {
+        if (mod->param == NWVoice::Balance) {
+          events.push_back({ at, Event::TrackPan, t, mod->value, 0, std::llround(mod->transitionDuration * rate) });
+        } else if (mod->param == Sampler::PitchBend) {
+          events.push_back({ at, Event::TrackPitchBend, t, mod->value, 0, 0 });
+        }
+      }
+    }
+  }
+
+  // Tracks were read one after another; playback needs one timeline. The
+  // sort is stable so that each track's events stay in order.
+  std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.frame < b.frame; });
+  endFrame = 0;
+  for (const Event& event : events) {
+    endFrame = std::max(endFrame, event.frame);
+  }
+  for (const Note& note : notes) {
+    if (note.endFrame != INT64_MAX) {
+      endFrame = std::max(endFrame, note.endFrame);
+    }
+  }
+  for (Note& note : notes) {
+    note.endFrame = std::min(note.endFrame, std::max(endFrame, note.startFrame));
+  }
+  noteVoice.resize(notes.size());
+  rewind();
+  return !notes.empty();
+}
+
+bool NWPlayer::prepareBank(const RBNKFile* bank, const RWARFile* war, PanCurve panCurve)
+{
+  live = true;
+  panLaw = PanLaw::get(panCurve);
+  events.clear();
+  endFrame = 0;
+
+  bool loaded = false;
+  sources.assign(war->numSamples(), PcmReader());
+  for (const RBNKFile::Region& region : bank->regions) {
+    int wave = region.sample.wave.pointer;
+    if (wave < 0 || wave >= sources.size() || sources[wave].numChannels) {
+      continue;
+    }
+    const SampleData* sample = war->getSample(wave);
+    if (!sample || sample->channels.empty() || sample->channels[0].empty()) {
+      continue;
+    }
+    sources[wave] = PcmReader(sample);
+    loaded = true;
+  }
+
+  // The same instruments that RBNKFile::registerInstruments() makes, one per
+  // channel, turn keys into notes.
+  channels.assign(NUM_CHANNELS, NWInstrument(nullptr, bank, war, 0, nullptr, 64, panLaw));
+  trackGain.assign(NUM_CHANNELS, 1.0);
+
+  // A live note is kept in the slot of the voice that plays it, so there is
+  // never a note without room for it.
+  notes.assign(voices.size(), Note());
+  noteVoice.resize(notes.size());
+  rewind();
+  return loaded;
+}
+
+void NWPlayer::setAudibility(double level, double holdTime)
+{
+  cullLevel = level;
+  cullHold = holdTime;
+}
+
+void NWPlayer::noteOn(int channel, int key, int velocity)
+{
+  if (!live || channel < 0 || channel >= channels.size()) {
+    return;
+  }
+  if (velocity <= 0) {
+    noteOff(channel, key);
+    return;
+  }
+  NWInstrument::NoteParams params;
+  if (!channels[channel].buildNote(frame / rate, key, velocity, 0, params)) {
+    return;
+  }
+  if (params.wave < 0 || params.wave >= sources.size() || !sources[params.wave].numChannels) {
+    return;
+  }
+  int slot = allocVoice(params.priority);
+  if (slot < 0) {
+    return;
+  }
+  Note& note = notes[slot];
+  note.startFrame = frame;
+  note.endFrame = INT64_MAX;
+  note.track = channel;
+  note.key = key;
+  note.wave = params.wave;
+  note.priority = params.priority;
+  note.pitch = params.pitch;
+  note.pitchBend = params.pitchBend;
+  note.volume = params.volume;
+  note.pan = params.pan;
+  note.panOffset = params.regionPan - PanLaw::CENTER;
+  note.attack = int(params.attack);
+  note.hold = params.hold;
+  note.decay = params.decay;
+  note.sustain = params.sustain;
+  note.release = params.release;
+  note.modulation = params.modulation;
+  startVoice(slot, slot);
+}
+
+void NWPlayer::noteOff(int channel, int key)
+{
+  for (Voice& voice : voices) {
+    if (voice.active && voice.track == channel && notes[voice.note].key == key && voice.releaseFrame > frame) {
+      voice.releaseFrame = frame;
+    }
+  }
+}
+
+void NWPlayer::allNotesOff()
+{
+  for (Voice& voice : voices) {
+    if (voice.active && voice.releaseFrame > frame) {
+      voice.releaseFrame = frame;
+    }
+  }
+}
+
+void NWPlayer::setProgram(int channel, int program)
+{
+  if (channel >= 0 && channel < channels.size()) {
+    channels[channel].program = program;
+  }
+}
+
+void NWPlayer::setChannelVolume(int channel, double volume)
+{
+  if (channel >= 0 && channel < channels.size()) {
+    applyEvent({ frame, Event::TrackGain, channel, volume, 0, 0 });
+  }
+}
+
+void NWPlayer::setChannelPan(int channel, double pan)
+{
+  if (channel >= 0 && channel < channels.size()) {
+    channels[channel].pan = pan;
+    applyEvent({ frame, Event::TrackPan, channel, pan, 0, 0 });
+  }
+}
+
+void NWPlayer::setPitchBend(int channel, double semitones)
+{
+  if (channel >= 0 && channel < channels.size()) {
+    channels[channel].pitchBend = semitones;
+    applyEvent({ frame, Event::TrackPitchBend, channel, semitonesToFactor(semitones), 0, 0 });
+  }
+}
+
+void NWPlayer::rewind()
+{
+  nextEvent = 0;
+  frame = 0;
+  for (Voice& voice : voices) {
+    voice.active = false;
+  }
+  std::fill(noteVoice.begin(), noteVoice.end(), -1);
+  std::fill(trackGain.begin(), trackGain.end(), 1.0);
+}
+
+void NWPlayer::saveState(State& state) const
+{
+  state.voices = voices;
+  state.noteVoice = noteVoice;
+  state.trackGain = trackGain;
+  state.nextEvent = nextEvent;
+  state.frame = frame;
+  state.nextSerial = nextSerial;
+}
+
+void NWPlayer::restoreState(const State& state)
+{
+  voices = state.voices;
+  noteVoice = state.noteVoice;
+  trackGain = state.trackGain;
+  nextEvent = state.nextEvent;
+  frame = state.frame;
+  nextSerial = state.nextSerial;
+}
+
+bool NWPlayer::isFinished() const
+{
+  if (nextEvent < events.size()) {
+    return false;
+  }
+  for (const Voice& voice : voices) {
+    if (voice.active) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void NWPlayer::skipTo(std::int64_t target)
+{
+  float scratch[512];
+  while (frame < target) {
+    int frames = std::min<std::int64_t>(target - frame, 256);
+    if (render(scratch, frames) < frames) {
+      return;
+    }
+  }
+}
+
+int NWPlayer::render(float* buffer, int frames)
+{
+  std::fill(buffer, buffer + frames * 2, 0.0f);
+  int done = 0;
+  while (done < frames) {
+    while (nextEvent < events.size() && events[nextEvent].frame <= frame) {
+      applyEvent(events[nextEvent++]);
+    }
+    if (!live && isFinished()) {
+      break;
+    }
+    int chunk = frames - done;
+    if (nextEvent < events.size() && events[nextEvent].frame - frame < chunk) {
+      chunk = events[nextEvent].frame - frame;
+    }
+    mix(buffer + done * 2, chunk);
+    frame += chunk;
+    done += chunk;
+  }
+  return done;
+}
+
+void NWPlayer::applyEvent(const Event& event)
+{
+  switch (event.type) {
+  case Event::NoteOn:
+    startNote(event.index);
+    break;
+  case Event::NoteUpdate: {
+    int slot = noteVoice[event.index];
+    if (slot < 0 || !voices[slot].active || voices[slot].note != event.index) {
+      break;
+    }
+    Voice& voice = voices[slot];
+    if (event.value >= 0) {
+      voice.pitch = event.value;
+    }
+    if (event.value2 >= 0) {
+      voice.volume = event.value2;
+    }
+    voice.releaseFrame = event.frames;
+    voice.nextControl = -1;
+    break;
+  }
+  case Event::TrackGain:
+    trackGain[event.index] = event.value;
+    break;
+  case Event::TrackPan:
+    for (Voice& voice : voices) {
+      if (voice.active && voice.track == event.index) {
+        voice.panFrom = voice.panFrames > 0 && frame < voice.panStart + voice.panFrames
+          ? lerp(voice.panFrom, voice.panTo, double(frame - voice.panStart) / voice.panFrames)
+          : voice.panTo;
+        voice.panTo = event.value;
+        voice.panStart = frame;
+        voice.panFrames = event.frames;
+      }
+    }
+    break;
+  case Event::TrackPitchBend:
+    for (Voice& voice : voices) {
+      if (voice.active && voice.track == event.index) {
+        voice.pitchBend = event.value;
+      }
+    }
+    break;
+  }
+}
+
+int NWPlayer::allocVoice(int priority)
+{
+  // The same policy as VoicePool: a free voice if there is one, otherwise
+  // the first voice in its stealing order that doesn't outrank the new note.
+  int numVoices = voices.size();
+  int victim = -1;
+  for (int i = 0; i < numVoices; i++) {
+    const Voice& voice = voices[i];
+    if (!voice.active) {
+      return i;
+    }
+    if (voice.priority > priority) {
+      continue;
+    }
+    if (victim < 0 || VoicePool::stealsBefore(rank(voice), rank(voices[victim]))) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+VoicePool::Rank NWPlayer::rank(const Voice& voice) const
+{
+  return VoicePool::Rank{ voice.priority, frame >= voice.releaseFrame, voice.envelope.stepper.lastLevel, voice.serial };
+}
+
+void NWPlayer::startNote(int noteIndex)
+{
+  int slot = allocVoice(notes[noteIndex].priority);
+  if (slot >= 0) {
+    startVoice(slot, noteIndex);
+  }
+}
+
+void NWPlayer::startVoice(int slot, int noteIndex)
+{
+  const Note& note = notes[noteIndex];
+  Voice& voice = voices[slot];
+  voice.active = true;
+  voice.note = noteIndex;
+  voice.track = note.track;
+  voice.priority = note.priority;
+  voice.serial = nextSerial++;
+  voice.reader = sources[note.wave];
+  voice.position = 0;
+  voice.pitch = note.pitch;
+  voice.pitchBend = note.pitchBend;
+  voice.volume = note.volume;
+  voice.panFrom = voice.panTo = note.pan;
+  voice.panStart = frame;
+  voice.panFrames = 0;
+  voice.control = VoiceControl(voice.reader.sampleRate / rate, panLaw, note.panOffset);
+  voice.modulation = note.modulation.isActive() ? &note.modulation : nullptr;
+  voice.startFrame = note.startFrame;
+  voice.releaseFrame = note.endFrame;
+  voice.nextControl = -1;
+  voice.first = true;
+  voice.envelope.start(note, cullLevel, cullHold);
+  noteVoice[noteIndex] = slot;
+}
+
+void NWPlayer::updateControl(Voice& voice, double time, std::int64_t at)
+{
+  double pan = voice.panTo;
+  if (voice.panFrames > 0 && at < voice.panStart + voice.panFrames) {
+    pan = lerp(voice.panFrom, voice.panTo, double(at - voice.panStart) / voice.panFrames);
+  }
+  voice.control.update(voice.pitch * voice.pitchBend, voice.volume, pan, voice.modulation, time);
+  voice.nextControl = time + NWVoice::CONTROL_PERIOD;
+}
+
+void NWPlayer::mix(float* buffer, int frames)
+{
+  for (Voice& voice : voices) {
+    if (voice.active) {
+      renderVoice(voice, buffer, frames);
+    }
+  }
+}
+
+void NWPlayer::renderVoice(Voice& voice, float* buffer, int frames)
+{
+  PcmReader& reader = voice.reader;
+  const double scale = trackGain[voice.track] / 32768.0;
+  std::int64_t at = frame;
+  for (int i = 0; i < frames; i++, at++) {
+    double time = (at - voice.startFrame) / rate;
+    if (time >= voice.nextControl) {
+      updateControl(voice, time, at);
+    }
+    if (!voice.first) {
+      voice.position += voice.control.increment;
+    }
+    voice.first = false;
+    if (!seekVoiceFrame(reader, voice.position)) {
+      voice.active = false;
+      return;
+    }
+
+    // Culled on the voice's own gain, like NWVoice, which doesn't see the
+    // track volume. A track turned down for a while can come back up, so
+    // its voices shouldn't be retired by it anyway.
+    double level = voice.envelope.levelAt(time, at >= voice.releaseFrame, voice.control.gain);
+    if (level < 0) {
+      voice.active = false;
+      return;
+    }
+    double s[2];
+    readVoiceFrame(reader, voice.position, s);
+    double g = level * voice.control.gain * scale;
+    buffer[i * 2] += s[0] * g * voice.control.panLeft;
+    buffer[i * 2 + 1] += s[1] * g * voice.control.panRight;
+  }
+}
+
+void NWPlayer::Envelope::start(const Note& note, double cullLevel, double cullHold)
+{
+  attack = note.attack;
+  hold = note.hold;
+  decay = note.decay;
+  sustain = note.sustain;
+  release = note.release;
+  numPhases = 0;
+  if (note.attack < 127) {
+    phases[numPhases++] = Attack;
+  }
+  if (note.hold > 0) {
+    phases[numPhases++] = Hold;
+  }
+  if (note.sustain < 127) {
+    phases[numPhases++] = Decay;
+  }
+  phases[numPhases++] = Sustain;
+
+  DiscreteEnvelope::Step initial = NWInstrument::startStep(attack);
+  stepper = DiscreteEnvelope::Stepper(initial.nextVolume, initial.userData);
+  stepper.cullLevel = cullLevel;
+  stepper.cullHold = cullHold;
+  stepper.attackPhases = note.attack < 127 ? 1 : 0;
+  done = false;
+}
+
+DiscreteEnvelope::Step NWPlayer::Envelope::next(int phase, double last, double user) const
+{
+  if (phase < 0) {
+    return NWInstrument::releaseStep(release, last, user);
+  }
+  switch (phases[phase]) {
+  case Attack:
+    return NWInstrument::attackStep(attack, last, user);
+  case Hold:
+    return NWInstrument::holdStep(hold, last, user);
+  case Decay:
+    return NWInstrument::decayStep(decay, sustain, last, user);
+  default:
+    return NWInstrument::sustainStep(last, user);
+  }
+}
+
+double NWPlayer::Envelope::levelAt(double time, bool released, double gain)
+{
+  if (done) {
+    return -1;
+  }
+  if (stepper.step > 0 && released) {
+    stepper.release(time);
+  }
+  double level = stepper.advance(time, numPhases, true, gain, [this](int phase, double last, double user) {
+    return next(phase, last, user);
+  });
+  done = level < 0;
+  return level;
+}
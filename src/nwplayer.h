@@ -0,0 +1,214 @@
+#ifndef NW_NWPLAYER_H
+#define NW_NWPLAYER_H
+
+#include <cstdint>
+#include <vector>
+#include "discreteenvelope.h"
+#include "modulation.h"
+#include "pcmreader.h"
+#include "voicecontrol.h"
+#include "voicepool.h"
+#include "nwinstrument.h"
+#include "rvl/infochunk.h"
+class RSEQFile;
+class RBNKFile;
+class RWARFile;
+class PanLaw;
+
+// Plays a sequence into a caller-provided buffer for audio callbacks.
+//
+// prepare() does all of the work that allocates, locks or touches files: it
+// reads every track of the sequence into a timeline of notes and track
+// events, decodes every wave that the timeline uses, and sizes the voice
+// table. render() then only walks the timeline and mixes voices from that
+// table, so it is safe to call from a real-time audio thread.
+//
+// Notes, ties, track volume, pan and pitch bend, envelopes, modulation and
+// the pan curve are handled as in the offline renderer. Track filters and
+// aux sends are not.
+//
+// Instead of a sequence, the player can be given a bank to play live, as an
+// instrument. Notes are then started and stopped by the caller between calls
+// to render(), with the programs of the bank on sixteen channels like MIDI.
+// To start a note partway through a host buffer, render up to that point,
+// start the note and render the rest.
+class NWPlayer
+{
+public:
+  NWPlayer(double sampleRate, int maxVoices = DEFAULT_VOICES);
+  NWPlayer(const NWPlayer& other) = delete;
+  NWPlayer& operator=(const NWPlayer& other) = delete;
+
+  // The hardware mixed up to 96 voices; leave room for release tails.
+  static constexpr int DEFAULT_VOICES = 128;
+
+  // Not real-time safe. The sequence must have its bank loaded, and is read
+  // to the end. The decoded samples belong to the wave archive's sample
+  // cache, which must outlive the player. Returns false if the sequence has
+  // nothing to play.
+  bool prepare(RSEQFile* seq, const RWARFile* war, PanCurve panCurve = _PanCurve::SQRT);
+
+  // Not real-time safe. Replaces any prepared sequence with live playing of
+  // the bank, and decodes every wave that the bank uses. The samples belong to
+  // the wave archive's sample cache, as with prepare(). Returns false if the
+  // bank has nothing to play.
+  bool prepareBank(const RBNKFile* bank, const RWARFile* war, PanCurve panCurve = _PanCurve::SQRT);
+
+  static constexpr int NUM_CHANNELS = 16;
+
+  // Voices that stay below level for holdTime seconds after their attack are
+  // stopped early, as in the offline renderer. A level of 0 disables this.
+  // Takes effect for voices started afterwards.
+  void setAudibility(double level, double holdTime);
+
+  // Live playing, after prepareBank(). All of these are real-time safe and
+  // take effect at the current position. Volume and pan are 0 to 1, with a
+  // pan of 0.5 at center.
+  void noteOn(int channel, int key, int velocity);
+  void noteOff(int channel, int key);
+  void allNotesOff();
+  void setProgram(int channel, int program);
+  void setChannelVolume(int channel, double volume);
+  void setChannelPan(int channel, double pan);
+  void setPitchBend(int channel, double semitones);
+
+  // Fills buffer with up to frames interleaved stereo frames and returns the
+  // number written, which is less than frames only at the end of the
+  // sequence. In live playing, always fills the whole buffer. Real-time safe.
+  int render(float* buffer, int frames);
+
+  // Starts again from the beginning. Real-time safe.
+  void rewind();
+
+  // Renders and discards output until the specified frame, or the end.
+  // Real-time safe, but takes time proportional to the distance skipped.
+  void skipTo(std::int64_t frame);
+
+  // The playback position and everything that depends on it. Restoring a
+  // saved state returns to that point without rendering up to it again.
+  struct State;
+
+  // Neither is real-time safe: saving allocates the first time a state is
+  // used. The state must come from this player after the same prepare().
+  void saveState(State& state) const;
+  void restoreState(const State& state);
+
+  inline double sampleRate() const { return rate; }
+  inline std::int64_t position() const { return frame; }
+  inline std::int64_t lengthFrames() const { return endFrame; }
+  inline double duration() const { return endFrame / rate; }
+  bool isFinished() const;
+
+private:
+  struct Note {
+    std::int64_t startFrame;
+    std::int64_t endFrame;
+    int track;
+    int key; // live notes only
+    int wave;
+    int priority;
+    double pitch;
+    double pitchBend;
+    double volume;
+    double pan;
+    int panOffset;
+    int attack;
+    double hold, decay, sustain, release;
+    Modulation modulation;
+  };
+
+  struct Event {
+    enum Type {
+      NoteOn,
+      NoteUpdate,
+      TrackGain,
+      TrackPan,
+      TrackPitchBend,
+    };
+
+    std::int64_t frame;
+    int type;
+    int index; // note for NoteOn/NoteUpdate, track otherwise
+    double value;
+    double value2;
+    std::int64_t frames; // new end frame for NoteUpdate, ramp length for TrackPan
+  };
+
+  // NWInstrument's envelope phases, stepped by DiscreteEnvelope's stepper
+  // without std::function so that starting a voice allocates nothing.
+  struct Envelope {
+    enum Phase { Attack, Hold, Decay, Sustain };
+
+    void start(const Note& note, double cullLevel, double cullHold);
+    double levelAt(double time, bool released, double gain);
+    DiscreteEnvelope::Step next(int phase, double last, double user) const;
+
+    Phase phases[4];
+    int numPhases;
+    DiscreteEnvelope::Stepper stepper;
+    bool done;
+    int attack;
+    double hold, decay, sustain, release;
+  };
+
+  struct Voice {
+    bool active;
+    int note;
+    int track;
+    int priority;
+    std::uint64_t serial;
+    PcmReader reader;
+    double position;
+    double pitch;
+    double pitchBend;
+    double volume;
+    double panFrom, panTo;
+    std::int64_t panStart, panFrames;
+    VoiceControl control;
+    const Modulation* modulation;
+    std::int64_t startFrame;
+    std::int64_t releaseFrame;
+    double nextControl;
+    bool first;
+    Envelope envelope;
+  };
+
+public:
+  struct State {
+    std::vector<Voice> voices;
+    std::vector<int> noteVoice;
+    std::vector<double> trackGain;
+    std::size_t nextEvent;
+    std::int64_t frame;
+    std::uint64_t nextSerial;
+  };
+
+private:
+  void applyEvent(const Event& event);
+  void startNote(int noteIndex);
+  void startVoice(int slot, int noteIndex);
+  int allocVoice(int priority);
+  VoicePool::Rank rank(const Voice& voice) const;
+  void updateControl(Voice& voice, double time, std::int64_t at);
+  void mix(float* buffer, int frames);
+  void renderVoice(Voice& voice, float* buffer, int frames);
+
+  double rate;
+  const PanLaw* panLaw;
+  std::vector<Note> notes;
+  std::vector<Event> events;
+  std::vector<PcmReader> sources;
+  std::vector<Voice> voices;
+  std::vector<int> noteVoice;
+  std::vector<double> trackGain;
+  std::size_t nextEvent;
+  std::int64_t frame;
+  std::int64_t endFrame;
+  std::uint64_t nextSerial;
+  double cullLevel;
+  double cullHold;
+  bool live;
+  std::vector<NWInstrument> channels;
+};
+
+#endif
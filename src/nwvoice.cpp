@@ -0,0 +1,220 @@
+#include "nwvoice.h"
+#include "dspadpcmcodec.h"
+#include "pcmreader.h"
+#include "rvl/rwarfile.h"
+#include "rvl/rwavfile.h"
+#include "codec/sampledata.h"
+#include "synth/sampler.h"
+#include "synth/synthcontext.h"
+#include "synth/iinterpolator.h"
+#include "utility.h"
+#include <cmath>
+
+namespace {
+
+// Decodes DSP-ADPCM incrementally as the read position advances, restarting
+// loops from the loop context stored in the RWAV header.
+struct AdpcmReader
+{
+  AdpcmReader(const RWAVFile* wave)
+  : numChannels(wave->channels.size() > 1 ? 2 : 1),
+    loopStart(wave->looped ? std::int32_t(dspAdpcmSampleCount(wave->loopStart)) : -1),
+    loopEnd(dspAdpcmSampleCount(wave->loopEnd)),
+    sampleRate(wave->sampleRate),
+    pos(0)
+  {
+    length = loopEnd;
+    const NWChunk* data = wave->section('DATA');
+    for (int i = 0; i < numChannels; i++) {
+      const RWAVFile::ChannelInfo& ch = wave->channels[i];
+      Channel& c = channels[i];
+      c.stream = DspAdpcmStream(data->rawData.data() + ch.sampleOffset, loopEnd + 1, ch.adpcm.coef, ch.adpcm.history1, ch.adpcm.history2);
+      c.loopHistory1 = ch.adpcm.loopHistory1;
+      c.loopHistory2 = ch.adpcm.loopHistory2;
+      c.current = c.stream.next();
+      c.next = c.stream.next();
+    }
+  }
+
+  inline void seek(std::uint32_t index)
+  {
+    if (index == pos) {
+      return;
+    }
+    for (int i = 0; i < numChannels; i++) {
+      Channel& c = channels[i];
+      std::uint32_t p = pos;
+      if (index < p) {
+        c.stream.seek(loopStart, c.loopHistory1, c.loopHistory2);
+        c.current = c.stream.next();
+        c.next = c.stream.next();
+        p = loopStart;
+      }
+      while (p < index) {
+        c.current = c.next;
+        c.next = c.stream.next();
+        ++p;
+      }
+    }
+    pos = index;
+  }
+
+  inline void read(double frac, double* out) const
+  {
+    for (int i = 0; i < numChannels; i++) {
+      out[i] = channels[i].current + (channels[i].next - channels[i].current) * frac;
+    }
+  }
+
+  struct Channel {
+    DspAdpcmStream stream;
+    std::int16_t current;
+    std::int16_t next;
+    std::int16_t loopHistory1;
+    std::int16_t loopHistory2;
+  };
+
+  Channel channels[2];
+  int numChannels;
+  std::uint32_t length;
+  std::int32_t loopStart;
+  std::uint32_t loopEnd;
+  double sampleRate;
+  std::uint32_t pos;
+};
+
+// Reads the frame at position through the context's interpolator. Returns
+// false if the reader has no decoded sample for it to use.
+inline bool interpolateFrame(const IInterpolator* interpolator, const PcmReader& reader, double position, double* out)
+{
+  double time = position / reader.sampleRate;
+  out[0] = interpolator->interpolate(reader.sample, time, 0, reader.sampleRate);
+  out[1] = reader.numChannels < 2 ? out[0] : interpolator->interpolate(reader.sample, time, 1, reader.sampleRate);
+  return true;
+}
+
+inline bool interpolateFrame(const IInterpolator*, const AdpcmReader&, double, double*)
+{
+  return false;
+}
+
+template <typename Reader>
+class NWVoiceImpl : public NWVoice
+{
+public:
+  NWVoiceImpl(const SynthContext* ctx, const Reader& reader, double pitch, double pitchBend, double startLevel, double startUser)
+  : NWVoice(ctx, reader.sampleRate, pitch, pitchBend, startLevel, startUser), reader(reader), position(0)
+  {
+    // initializers only
+  }
+
+  virtual double duration() const override
+  {
+    return reader.loopStart >= 0 ? HUGE_VAL : reader.length / reader.sampleRate;
+  }
+
+protected:
+  virtual void renderFrame(double time) override
+  {
+    if (time >= nextControl) {
+      updateControl(time);
+    }
+    if (frameTime >= 0) {
+      position += control.increment;
+    }
+    if (!seekVoiceFrame(reader, position)) {
+      sourceDone = true;
+      frame[0] = frame[1] = 0;
+      return;
+    }
+
+    double level = levelAt(time);
+    if (level < 0) {
+      frame[0] = frame[1] = 0;
+      return;
+    }
+    double s[2];
+    if (!interpolator || !interpolateFrame(interpolator, reader, position, s)) {
+      readVoiceFrame(reader, position, s);
+    }
+    double g = level * control.gain;
+    frame[0] = clamp<int>(s[0] * g * control.panLeft, -0x8000, 0x7FFF);
+    frame[1] = clamp<int>(s[1] * g * control.panRight, -0x8000, 0x7FFF);
+  }
+
+  Reader reader;
+  double position;
+};
+
+}
+
+NWVoice* NWVoice::create(const SynthContext* ctx, const RWARFile* war, int waveIndex,
+    double pitch, double pitchBend, double startLevel, double startUser)
+{
+  if (war->playsDirect(waveIndex)) {
+    const RWAVFile* wave = war->wave(waveIndex);
+    if (wave->channels.empty()) {
+      return nullptr;
+    }
+    return new NWVoiceImpl<AdpcmReader>(ctx, AdpcmReader(wave), pitch, pitchBend, startLevel, startUser);
+  }
+  SampleData* sample = war->getSample(waveIndex);
+  if (!sample || sample->channels.empty() || sample->channels[0].empty()) {
+    return nullptr;
+  }
+  return new NWVoiceImpl<PcmReader>(ctx, PcmReader(sample), pitch, pitchBend, startLevel, startUser);
+}
+
+NWVoice::NWVoice(const SynthContext* ctx, double sampleRate, double pitch, double pitchBend, double startLevel, double startUser)
+: DiscreteEnvelope(ctx, startLevel, startUser),
+  interpolator(ctx->interpolator == IInterpolator::get(IInterpolator::Linear) ? nullptr : ctx->interpolator),
+  frameTime(-1),
+  nextControl(-1),
+  control(sampleRate / ctx->sampleRate),
+  modulated(false),
+  frame{ 0, 0 },
+  sourceDone(false)
+{
+  addParam(Sampler::Pitch, pitch);
+  addParam(Sampler::PitchBend, pitchBend);
+  addParam(Volume, 1.0);
+  addParam(Balance, 0.5);
+}
+
+bool NWVoice::isActive() const
+{
+  return !allDone && !sourceDone;
+}
+
+void NWVoice::setModulation(const Modulation& modulation)
+{
+  this->modulation = modulation;
+  modulated = modulation.isActive();
+}
+
+void NWVoice::setPanLaw(const PanLaw* panLaw, int panOffset)
+{
+  control.panLaw = panLaw;
+  control.panOffset = panOffset;
+  control.lastPan = -1;
+}
+
+void NWVoice::updateControl(double time)
+{
+  double pitch = paramValue(Sampler::Pitch, time, 1.0) * paramValue(Sampler::PitchBend, time, 1.0);
+  control.update(pitch, paramValue(Volume, time, 1.0), paramValue(Balance, time, 0.5), modulated ? &modulation : nullptr, time);
+  outputGain = control.gain;
+  nextControl = time + CONTROL_PERIOD;
+}
+
+int16_t NWVoice::generateSample(double time, int channel)
+{
+  if (time != frameTime) {
+    renderFrame(time);
+    frameTime = time;
+  }
+  if (ctx->outputChannels < 2) {
+    return (frame[0] + frame[1]) / 2;
+  }
+  return frame[channel & 1];
+}
@@ -0,0 +1,68 @@
+#ifndef NW_NWVOICE_H
+#define NW_NWVOICE_H
+
+#include "discreteenvelope.h"
+#include "modulation.h"
+#include "voicecontrol.h"
+class RWARFile;
+class PanLaw;
+class IInterpolator;
+
+// A complete voice in a single node: sample read, interpolation, envelope,
+// gain and pan are computed together for each output frame instead of being
+// pulled through a chain of nodes. Specialized per sample source by the
+// implementations in nwvoice.cpp.
+//
+// Linear interpolation is done inline. Any other interpolator set on the
+// context is used for decoded waves; ADPCM decoded on the fly has no
+// SampleData for it to read, so it is always interpolated linearly.
+class NWVoice : public DiscreteEnvelope
+{
+public:
+  // Creates a voice for the specified wave. ADPCM waves are decoded on the fly
+  // if the archive is set to play them directly.
+  static NWVoice* create(const SynthContext* ctx, const RWARFile* war, int waveIndex,
+      double pitch, double pitchBend, double startLevel, double startUser);
+
+  // The note's velocity gain and pan (0 = left, 1 = right). The voice applies
+  // these itself, through the pan curve, so the node's own Gain and Pan are
+  // left at unity and center for the base class to apply.
+  enum ParamType : int32_t {
+    Volume = 'nwvo',
+    Balance = 'nwpa',
+  };
+
+  virtual bool isActive() const override;
+  // The length of the wave in seconds, or HUGE_VAL if it loops.
+  virtual double duration() const = 0;
+
+  void setModulation(const Modulation& modulation);
+
+  // Sets the curve used to turn the Balance parameter into channel gains, and a
+  // fixed offset in pan units (64 = center) from the bank region.
+  void setPanLaw(const PanLaw* panLaw, int panOffset = 0);
+
+  // Parameters are sampled once per control period, matching the ~3ms update
+  // interval of the original DSP, rather than on every output sample.
+  static constexpr double CONTROL_PERIOD = 0.003;
+
+protected:
+  NWVoice(const SynthContext* ctx, double sampleRate, double pitch, double pitchBend, double startLevel, double startUser);
+
+  virtual int16_t generateSample(double time, int channel = 0) override;
+  virtual void renderFrame(double time) = 0;
+
+  void updateControl(double time);
+
+  // Null for the inline linear interpolation.
+  const IInterpolator* interpolator;
+  double frameTime;
+  double nextControl;
+  VoiceControl control;
+  Modulation modulation;
+  bool modulated;
+  std::int16_t frame[2];
+  bool sourceDone;
+};
+
+#endif
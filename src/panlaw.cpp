@@ -0,0 +1,56 @@
+#include "panlaw.h"
+#include <cmath>
+
+// M_PI and M_SQRT1_2 aren't part of standard C++, and MSVC only defines them
+// on request.
+static constexpr double PI = 3.14159265358979323846;
+static constexpr double SQRT1_2 = 0.70710678118654752440;
+
+PanLaw::PanLaw(PanCurve curve)
+{
+  int base = curve / 3;
+  bool zeroDB = curve % 3 != 0;
+  bool clampGain = curve % 3 == 2;
+  for (int i = 0; i < NUM_POSITIONS; i++) {
+    // -1 to 1, with the center exactly at 0.
+    double x = i < CENTER ? (i - CENTER) / double(CENTER) : (i - CENTER) / double(NUM_POSITIONS - 1 - CENTER);
+    double left, right, centerGain;
+    if (base == _PanCurve::SIN_COS / 3) {
+      left = std::cos((x + 1) * PI / 4);
+      right = std::sin((x + 1) * PI / 4);
+      centerGain = SQRT1_2;
+    } else if (base == _PanCurve::LINEAR / 3) {
+      left = (1 - x) / 2;
+      right = (1 + x) / 2;
+      centerGain = 0.5;
+    } else {
+      left = std::sqrt((1 - x) / 2);
+      right = std::sqrt((1 + x) / 2);
+      centerGain = SQRT1_2;
+    }
+    if (zeroDB) {
+      // Scale so that the center is at unity gain.
+      left /= centerGain;
+      right /= centerGain;
+    }
+    if (clampGain) {
+      left = left > 1 ? 1 : left;
+      right = right > 1 ? 1 : right;
+    }
+    gains[i][0] = left;
+    gains[i][1] = right;
+  }
+}
+
+const PanLaw* PanLaw::get(PanCurve curve)
+{
+  static const PanLaw laws[] = {
+    PanLaw(_PanCurve::SQRT), PanLaw(_PanCurve::SQRT_0DB), PanLaw(_PanCurve::SQRT_0DB_CLAMP),
+    PanLaw(_PanCurve::SIN_COS), PanLaw(_PanCurve::SIN_COS_0DB), PanLaw(_PanCurve::SIN_COS_0DB_CLAMP),
+    PanLaw(_PanCurve::LINEAR), PanLaw(_PanCurve::LINEAR_0DB), PanLaw(_PanCurve::LINEAR_0DB_CLAMP),
+  };
+  if (curve < 0 || curve > _PanCurve::LINEAR_0DB_CLAMP) {
+    return &laws[_PanCurve::SQRT];
+  }
+  return &laws[curve];
+}
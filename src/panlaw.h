@@ -0,0 +1,25 @@
+#ifndef NW_PANLAW_H
+#define NW_PANLAW_H
+
+#include "rvl/infochunk.h"
+
+// Left and right gains for each pan position under one of the NW4R pan
+// curves. Position 64 is center, 0 is hard left and 127 is hard right.
+class PanLaw
+{
+public:
+  static const PanLaw* get(PanCurve curve);
+
+  static constexpr int NUM_POSITIONS = 128;
+  static constexpr int CENTER = 64;
+
+  inline float left(int position) const { return gains[position][0]; }
+  inline float right(int position) const { return gains[position][1]; }
+
+private:
+  PanLaw(PanCurve curve);
+
+  float gains[NUM_POSITIONS][2];
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "pcmdiskcache.h"
+#include "codec/sampledata.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static constexpr std::uint32_t BLOB_MAGIC = 0x4350574E; // "NWPC" on little-endian hosts
+static constexpr std::uint32_t BLOB_VERSION = 1;
+static constexpr std::uint32_t BLOB_MAX_CHANNELS = 16;
+
+// Distinguishes the temporary files of every writer, in this process and in
+// any other process sharing the cache directory.
+static std::string tempSuffix()
+{
+  static std::atomic<std::uint64_t> counter(0);
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = getpid();
+#endif
+  std::ostringstream suffix;
+  suffix << "." << pid << "." << counter++ << ".tmp";
+  return suffix.str();
+}
+
+struct BlobHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t key;
+  double sampleRate;
+  std::int32_t loopStart;
+  std::int32_t loopEnd;
+  std::uint32_t numChannels;
+  std::uint32_t channelLength[BLOB_MAX_CHANNELS];
+};
+
+namespace {
+// Read-only view of a whole file, memory-mapped where supported.
+class MappedFile
+{
+public:
+  MappedFile(const std::string& path) : data(nullptr), size(0)
+  {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data = static_cast<const std::uint8_t*>(mapped);
+        size = st.st_size;
+      }
+    }
+    ::close(fd);
+#else
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    if (!is) {
+      return;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    data = reinterpret_cast<const std::uint8_t*>(buffer.data());
+    size = buffer.size();
+#endif
+  }
+
+  ~MappedFile()
+  {
+#ifndef _WIN32
+    if (data) {
+      ::munmap(const_cast<std::uint8_t*>(data), size);
+    }
+#endif
+  }
+
+  const std::uint8_t* data;
+  std::size_t size;
+
+private:
+#ifdef _WIN32
+  std::vector<char> buffer;
+#endif
+};
+}
+
+PcmDiskCache::PcmDiskCache(const std::string& path)
+: dirPath(path), valid(false)
+{
+  std::error_code ec;
+  std::filesystem::create_directories(dirPath, ec);
+  valid = std::filesystem::is_directory(dirPath, ec);
+}
+
+std::string PcmDiskCache::blobPath(std::uint64_t key) const
+{
+  std::ostringstream ss;
+  ss << dirPath << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".pcm";
+  return ss.str();
+}
+
+SampleData* PcmDiskCache::load(ClefContext* ctx, std::uint64_t key) const
+{
+  if (!valid) {
+    return nullptr;
+  }
+  MappedFile file(blobPath(key));
+  if (!file.data || file.size < sizeof(BlobHeader)) {
+    return nullptr;
+  }
+  BlobHeader header;
+  std::memcpy(&header, file.data, sizeof(BlobHeader));
+  if (header.magic != BLOB_MAGIC || header.version != BLOB_VERSION || header.key != key ||
+      header.numChannels == 0 || header.numChannels > BLOB_MAX_CHANNELS) {
+    return nullptr;
+  }
+  std::size_t expected = sizeof(BlobHeader);
+  for (std::uint32_t i = 0; i < header.numChannels; i++) {
+    expected += std::size_t(header.channelLength[i]) * sizeof(std::int16_t);
+  }
+  if (expected != file.size) {
+    return nullptr;
+  }
+
+  SampleData* sample = new SampleData(ctx, SampleData::Uncached);
+  sample->sampleRate = header.sampleRate;
+  sample->loopStart = header.loopStart;
+  sample->loopEnd = header.loopEnd;
+  const std::int16_t* pcm = reinterpret_cast<const std::int16_t*>(file.data + sizeof(BlobHeader));
+  for (std::uint32_t i = 0; i < header.numChannels; i++) {
+    sample->channels.emplace_back(pcm, pcm + header.channelLength[i]);
+    pcm += header.channelLength[i];
+  }
+  return sample;
+}
+
+bool PcmDiskCache::store(std::uint64_t key, const SampleData* sample) const
+{
+  if (!valid || sample->channels.empty() || sample->channels.size() > BLOB_MAX_CHANNELS) {
+    return false;
+  }
+  BlobHeader header{};
+  header.magic = BLOB_MAGIC;
+  header.version = BLOB_VERSION;
+  header.key = key;
+  header.sampleRate = sample->sampleRate;
+  header.loopStart = sample->loopStart;
+  header.loopEnd = sample->loopEnd;
+  header.numChannels = sample->channels.size();
+  for (std::uint32_t i = 0; i < header.numChannels; i++) {
+    header.channelLength[i] = sample->channels[i].size();
+  }
+
+  // Write to a unique temporary name and rename into place so that a
+  // concurrent reader never sees a partial blob.
+  std::string path = blobPath(key);
+  std::ostringstream tmpPath;
+  tmpPath << path << tempSuffix();
+  {
+    std::ofstream os(tmpPath.str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!os) {
+      return false;
+    }
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& channel : sample->channels) {
+      os.write(reinterpret_cast<const char*>(channel.data()), channel.size() * sizeof(std::int16_t));
+    }
+    if (!os) {
+      std::error_code ec;
+      std::filesystem::remove(tmpPath.str(), ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath.str(), path, ec);
+  if (ec) {
+    std::filesystem::remove(tmpPath.str(), ec);
+    return false;
+  }
+  return true;
+}
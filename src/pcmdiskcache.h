@@ -0,0 +1,30 @@
+#ifndef NW_PCMDISKCACHE_H
+#define NW_PCMDISKCACHE_H
+
+#include <cstdint>
+#include <string>
+class SampleData;
+class ClefContext;
+
+// Directory of decoded PCM blobs keyed by wave content hash. Each blob is a
+// fixed header followed by native-endian 16-bit channel data, so loading one
+// is a mapping and a copy per channel with no decoding or parsing.
+class PcmDiskCache
+{
+public:
+  PcmDiskCache(const std::string& path);
+
+  inline const std::string& path() const { return dirPath; }
+  inline bool isValid() const { return valid; }
+
+  SampleData* load(ClefContext* ctx, std::uint64_t key) const;
+  bool store(std::uint64_t key, const SampleData* sample) const;
+
+private:
+  std::string blobPath(std::uint64_t key) const;
+
+  std::string dirPath;
+  bool valid;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef NW_PCMREADER_H
+#define NW_PCMREADER_H
+
+#include <cstdint>
+#include "codec/sampledata.h"
+
+// Reads 16-bit PCM from a decoded SampleData. Used for PCM8, PCM16 and
+// ADPCM waves that have been decoded ahead of time.
+struct PcmReader
+{
+  PcmReader()
+  : sample(nullptr), data{ nullptr, nullptr }, numChannels(0), length(0), loopStart(-1), loopEnd(0), sampleRate(0), pos(0)
+  {
+    // initializers only
+  }
+
+  PcmReader(const SampleData* sample)
+  : sample(sample),
+    numChannels(sample->channels.size() > 1 ? 2 : 1),
+    length(sample->channels[0].size()),
+    loopStart(sample->loopStart),
+    sampleRate(sample->sampleRate),
+    pos(0)
+  {
+    for (int i = 0; i < numChannels; i++) {
+      data[i] = sample->channels[i].data();
+      if (sample->channels[i].size() < length) {
+        length = sample->channels[i].size();
+      }
+    }
+    loopEnd = (loopStart >= 0 && sample->loopEnd > 0 && sample->loopEnd < length) ? sample->loopEnd : length;
+  }
+
+  inline void seek(std::uint32_t index)
+  {
+    pos = index;
+  }
+
+  inline void read(double frac, double* out) const
+  {
+    for (int i = 0; i < numChannels; i++) {
+      double s0 = data[i][pos];
+      double s1;
+      if (pos + 1 < loopEnd) {
+        s1 = data[i][pos + 1];
+      } else if (loopStart >= 0) {
+        s1 = data[i][loopStart];
+      } else {
+        s1 = 0;
+      }
+      out[i] = s0 + (s1 - s0) * frac;
+    }
+  }
+
+  const SampleData* sample;
+  const std::int16_t* data[2];
+  int numChannels;
+  std::uint32_t length;
+  std::int32_t loopStart;
+  std::uint32_t loopEnd;
+  double sampleRate;
+  std::uint32_t pos;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include "pcmsink.h"
+
+RiffSink::RiffSink(std::uint32_t sampleRate)
+: wav(sampleRate)
+{
+  // initializers only
+}
+
+bool RiffSink::open(const std::string& filename)
+{
+  return wav.open(filename);
+}
+
+void RiffSink::write(const std::vector<std::int16_t>& samples)
+{
+  wav.write(samples);
+}
+
+bool RiffSink::close()
+{
+  return wav.close();
+}
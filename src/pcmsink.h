@@ -0,0 +1,35 @@
+#ifndef NW_PCMSINK_H
+#define NW_PCMSINK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "wavstreamwriter.h"
+
+// Destination for rendered output: interleaved 16-bit stereo samples,
+// written a block at a time.
+class PcmSink
+{
+public:
+  virtual ~PcmSink() {}
+
+  virtual void write(const std::vector<std::int16_t>& samples) = 0;
+};
+
+// Writes each block to a WAV file as soon as it is rendered.
+class RiffSink : public PcmSink
+{
+public:
+  RiffSink(std::uint32_t sampleRate);
+
+  bool open(const std::string& filename);
+  virtual void write(const std::vector<std::int16_t>& samples) override;
+
+  // Finishes the file. Returns false if any of it could not be written.
+  bool close();
+
+private:
+  WavStreamWriter wav;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "prerenderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+Prerenderer::Prerenderer(NWPlayer* player, double depth)
+: underruns(0), player(player),
+  ring(std::max<int>(2, std::ceil(depth * player->sampleRate() / BLOCK_FRAMES))),
+  running(false), generation(0), seekTarget(0), readGeneration(0), readOffset(0), readFrame(player->position()),
+  finished(false), snapshotFrames(std::llround(SNAPSHOT_INTERVAL * player->sampleRate()))
+{
+  // initializers only
+}
+
+Prerenderer::~Prerenderer()
+{
+  stop();
+}
+
+void Prerenderer::start()
+{
+  if (thread.joinable()) {
+    return;
+  }
+  running = true;
+  thread = std::thread(&Prerenderer::run, this);
+}
+
+void Prerenderer::stop()
+{
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+bool Prerenderer::isFinished() const
+{
+  return finished;
+}
+
+int Prerenderer::read(float* buffer, int frames)
+{
+  int done = 0;
+  while (done < frames && !finished) {
+    Block* block = ring.front();
+    if (!block) {
+      break;
+    }
+    if (block->generation != readGeneration) {
+      // Rendered before the last seek.
+      ring.pop();
+      readOffset = 0;
+      continue;
+    }
+    int count = std::min(block->frames - readOffset, frames - done);
+    std::copy(block->samples + readOffset * 2, block->samples + (readOffset + count) * 2, buffer + done * 2);
+    done += count;
+    readOffset += count;
+    if (readOffset >= block->frames) {
+      finished = block->last;
+      ring.pop();
+      readOffset = 0;
+    }
+  }
+  readFrame += done;
+  if (done < frames) {
+    std::fill(buffer + done * 2, buffer + frames * 2, 0.0f);
+    if (!finished) {
+      ++underruns;
+      return frames;
+    }
+  }
+  return done;
+}
+
+void Prerenderer::seek(std::int64_t frame)
+{
+  ++readGeneration;
+  readOffset = 0;
+  readFrame = frame;
+  finished = false;
+  // The target has to be visible before the new generation is.
+  seekTarget.store(frame, std::memory_order_relaxed);
+  generation.store(readGeneration, std::memory_order_release);
+}
+
+void Prerenderer::run()
+{
+  snapshots.clear();
+  snapshotIfDue();
+
+  std::uint32_t current = generation.load(std::memory_order_acquire);
+  bool done = false;
+  while (running) {
+    std::uint32_t requested = generation.load(std::memory_order_acquire);
+    if (requested != current) {
+      current = requested;
+      restart(seekTarget.load(std::memory_order_relaxed));
+      done = false;
+      continue;
+    }
+    Block* block = done ? nullptr : ring.back();
+    if (!block) {
+      // Full, or at the end: wait for the consumer, or for a seek.
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      continue;
+    }
+    snapshotIfDue();
+    block->generation = current;
+    block->frames = player->render(block->samples, BLOCK_FRAMES);
+    block->last = block->frames < BLOCK_FRAMES;
+    ring.push();
+    done = block->last;
+  }
+}
+
+void Prerenderer::restart(std::int64_t target)
+{
+  if (target < 0) {
+    target = 0;
+  }
+  // Snapshots are taken in order, so the last one at or before the target is
+  // the closest.
+  auto iter = std::upper_bound(snapshots.begin(), snapshots.end(), target,
+      [](std::int64_t frame, const Snapshot& snapshot) { return frame < snapshot.frame; });
+  player->restoreState((iter == snapshots.begin() ? iter : iter - 1)->state);
+
+  // Render forward in snapshot-sized steps, so that seeking past the furthest
+  // point played so far leaves snapshots behind for the next seek.
+  while (player->position() < target) {
+    snapshotIfDue();
+    std::int64_t from = player->position();
+    player->skipTo(std::min(target, std::max(from, snapshots.back().frame) + snapshotFrames));
+    if (player->position() == from) {
+      break;
+    }
+  }
+}
+
+void Prerenderer::snapshotIfDue()
+{
+  if (!snapshots.empty() && player->position() < snapshots.back().frame + snapshotFrames) {
+    return;
+  }
+  snapshots.push_back(Snapshot{ player->position(), NWPlayer::State() });
+  player->saveState(snapshots.back().state);
+}
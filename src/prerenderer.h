@@ -0,0 +1,87 @@
+#ifndef NW_PRERENDERER_H
+#define NW_PRERENDERER_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "nwplayer.h"
+#include "spscring.h"
+
+// Renders a player ahead of playback on a background thread, so that a burst
+// of expensive passages is absorbed by the buffer instead of making the
+// audio callback miss its deadline.
+//
+// The render thread fills a lock-free ring of blocks; read() only copies out
+// of it. A seek is only a request: blocks rendered before it are dropped by
+// read(), and the render thread returns to the nearest state snapshot before
+// the target, renders forward to the target and refills the ring from there.
+// Snapshots are taken as playback first passes through the sequence.
+class Prerenderer
+{
+public:
+  // The player must be prepared and outlive the prerenderer. depth is how far
+  // ahead to render, in seconds.
+  Prerenderer(NWPlayer* player, double depth = DEFAULT_DEPTH);
+  ~Prerenderer();
+  Prerenderer(const Prerenderer& other) = delete;
+  Prerenderer& operator=(const Prerenderer& other) = delete;
+
+  static constexpr double DEFAULT_DEPTH = 0.5;
+  static constexpr int BLOCK_FRAMES = 256;
+  static constexpr double SNAPSHOT_INTERVAL = 5.0;
+
+  void start();
+  void stop();
+
+  // Copies up to frames interleaved stereo frames into buffer and returns the
+  // number copied, which is less than frames only at the end of the
+  // sequence. If the render thread has fallen behind, the rest of the buffer
+  // is filled with silence and counted as an underrun. Real-time safe.
+  int read(float* buffer, int frames);
+
+  // Restarts playback at the specified frame. Real-time safe.
+  void seek(std::int64_t frame);
+
+  // The frame that the next read() starts at.
+  inline std::int64_t position() const { return readFrame; }
+  bool isFinished() const;
+
+  std::atomic<std::uint64_t> underruns;
+
+private:
+  struct Block {
+    std::uint32_t generation;
+    int frames;
+    bool last;
+    float samples[BLOCK_FRAMES * 2];
+  };
+
+  struct Snapshot {
+    std::int64_t frame;
+    NWPlayer::State state;
+  };
+
+  void run();
+  void restart(std::int64_t target);
+  void snapshotIfDue();
+
+  NWPlayer* player;
+  SpscRing<Block> ring;
+  std::thread thread;
+  std::atomic<bool> running;
+  std::atomic<std::uint32_t> generation;
+  std::atomic<std::int64_t> seekTarget;
+
+  // Used by read() only.
+  std::uint32_t readGeneration;
+  int readOffset;
+  std::int64_t readFrame;
+  bool finished;
+
+  // Used by the render thread only.
+  std::int64_t snapshotFrames;
+  std::vector<Snapshot> snapshots;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "prerendertrack.h"
+#include "prerenderer.h"
+#include "seq/sequenceevent.h"
+#include "synth/synthcontext.h"
+#include "synth/audionode.h"
+#include "utility.h"
+#include <cmath>
+
+namespace {
+
+class PrerenderNode : public AudioNode
+{
+public:
+  PrerenderNode(const SynthContext* ctx, Prerenderer* source)
+  : AudioNode(ctx), source(source), nextFrame(source->position()), frameTime(-1), offset(0), available(0)
+  {
+    // initializers only
+  }
+
+  virtual bool isActive() const override
+  {
+    return offset < available || !source->isFinished();
+  }
+
+protected:
+  virtual std::int16_t generateSample(double time, int channel) override
+  {
+    if (time != frameTime) {
+      frameTime = time;
+      std::int64_t frame = std::llround(time * ctx->sampleRate);
+      if (frame != nextFrame) {
+        source->seek(frame);
+        offset = available = 0;
+      }
+      nextFrame = frame + 1;
+      if (offset < available) {
+        ++offset;
+      }
+      if (offset >= available) {
+        available = source->read(buffer, Prerenderer::BLOCK_FRAMES);
+        offset = 0;
+      }
+    }
+    if (offset >= available) {
+      return 0;
+    }
+    const float* frame = buffer + offset * 2;
+    float sample = ctx->outputChannels < 2 ? (frame[0] + frame[1]) * 0.5f : frame[channel & 1];
+    return clamp<int>(std::lround(sample * 32767.0f), -32768, 32767);
+  }
+
+private:
+  Prerenderer* source;
+  std::int64_t nextFrame;
+  double frameTime;
+  int offset;
+  int available;
+  float buffer[Prerenderer::BLOCK_FRAMES * 2];
+};
+
+}
+
+PrerenderTrack::Instrument::Instrument(Prerenderer* source)
+: source(source)
+{
+  // initializers only
+}
+
+Channel::Note* PrerenderTrack::Instrument::noteEvent(Channel* channel, std::shared_ptr<BaseNoteEvent> event)
+{
+  return channel->allocNote(event, new PrerenderNode(channel->ctx, source), event->duration);
+}
+
+PrerenderTrack::PrerenderTrack(Prerenderer* source, double duration)
+: instrument(source), duration(duration), nextEvent(0)
+{
+  // initializers only
+}
+
+bool PrerenderTrack::isFinished() const
+{
+  return nextEvent >= 2;
+}
+
+double PrerenderTrack::length() const
+{
+  return duration;
+}
+
+std::shared_ptr<SequenceEvent> PrerenderTrack::readNextEvent()
+{
+  switch (nextEvent++) {
+  case 0: {
+    std::shared_ptr<SequenceEvent> event(new SetInstrumentEvent(&instrument));
+    event->timestamp = 0;
+    return event;
+  }
+  case 1: {
+    // The prerendered output is already mixed and panned.
+    std::shared_ptr<InstrumentNoteEvent> event(new InstrumentNoteEvent);
+    event->timestamp = 0;
+    event->duration = duration;
+    event->volume = 1.0;
+    event->pan = 0.5;
+    event->pitch = 1.0;
+    return event;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+void PrerenderTrack::internalReset()
+{
+  nextEvent = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef NW_PRERENDERTRACK_H
+#define NW_PRERENDERTRACK_H
+
+#include "seq/itrack.h"
+#include "synth/iinstrument.h"
+class Prerenderer;
+
+// Plays the output of a Prerenderer through a SynthContext, for hosts that
+// pull audio with SynthContext::fillBuffer(). The track is a single note as
+// long as the sequence, and the voice of that note copies its output from
+// the prerenderer's ring. A jump in the time that the voice is asked for is
+// passed on to the prerenderer as a seek.
+class PrerenderTrack : public ITrack
+{
+public:
+  PrerenderTrack(Prerenderer* source, double duration);
+
+  virtual bool isFinished() const override;
+  virtual double length() const override;
+
+protected:
+  virtual std::shared_ptr<SequenceEvent> readNextEvent() override;
+  virtual void internalReset() override;
+
+private:
+  class Instrument : public IInstrument
+  {
+  public:
+    Instrument(Prerenderer* source);
+
+    virtual Channel::Note* noteEvent(Channel* channel, std::shared_ptr<BaseNoteEvent> event) override;
+
+  private:
+    Prerenderer* source;
+  };
+
+  Instrument instrument;
+  double duration;
+  int nextEvent;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "resampler.h"
+#include "utility.h"
+#include <cmath>
+#include <numeric>
+
+// M_PI isn't part of standard C++, and MSVC only defines it on request.
+static constexpr double PI = 3.14159265358979323846;
+
+static double besselI0(double x)
+{
+  double sum = 1, term = 1;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+Resampler::Resampler(std::uint32_t inputRate, std::uint32_t outputRate, int channels)
+: channels(channels < 2 ? 1 : 2), bufferStart(0), base(0), phase(0), inputFrames(0), outputFrames(0)
+{
+  std::uint64_t divisor = std::gcd(inputRate, outputRate);
+  up = outputRate / divisor;
+  down = inputRate / divisor;
+  if (isPassthrough()) {
+    half = taps = 0;
+    numPhases = 0;
+    return;
+  }
+  buildTable();
+
+  // Pad the start so that the first output frame is centered on the first
+  // input frame.
+  bufferStart = 1 - half;
+  for (int c = 0; c < this->channels; c++) {
+    buffer[c].assign(half - 1, 0.0f);
+  }
+}
+
+void Resampler::buildTable()
+{
+  // Cut off a little below the lower of the two Nyquist frequencies.
+  double cutoff = 0.92 * (up < down ? double(up) / down : 1.0);
+  half = int(std::ceil(ZERO_CROSSINGS / cutoff));
+  half = (half + 3) & ~3;
+  taps = half * 2;
+  numPhases = up < MAX_PHASES ? up : MAX_PHASES;
+
+  constexpr double beta = 8.6;
+  double norm = besselI0(beta);
+  // One extra row covers a phase that rounds up to the next input frame.
+  table.resize((numPhases + 1) * taps);
+  for (std::uint64_t row = 0; row <= numPhases; row++) {
+    float* coef = &table[row * taps];
+    double frac = double(row) / numPhases;
+    double sum = 0;
+    for (int k = 0; k < taps; k++) {
+      double t = frac + half - 1 - k;
+      double x = cutoff * t;
+      double sinc = x == 0 ? 1.0 : std::sin(PI * x) / (PI * x);
+      double w = t / half;
+      double window = (w <= -1 || w >= 1) ? 0.0 : besselI0(beta * std::sqrt(1 - w * w)) / norm;
+      coef[k] = sinc * window;
+      sum += coef[k];
+    }
+    // Normalize each phase separately so that DC passes at unity gain.
+    for (int k = 0; k < taps; k++) {
+      coef[k] /= sum;
+    }
+  }
+}
+
+void Resampler::process(const std::int16_t* input, int frames, std::vector<std::int16_t>& output)
+{
+  if (isPassthrough()) {
+    output.insert(output.end(), input, input + frames * channels);
+    return;
+  }
+  for (int c = 0; c < channels; c++) {
+    std::vector<float>& buf = buffer[c];
+    std::size_t offset = buf.size();
+    buf.resize(offset + frames);
+    for (int i = 0; i < frames; i++) {
+      buf[offset + i] = input[i * channels + c];
+    }
+  }
+  inputFrames += frames;
+  generate(output);
+}
+
+void Resampler::flush(std::vector<std::int16_t>& output)
+{
+  if (isPassthrough()) {
+    return;
+  }
+  for (int c = 0; c < channels; c++) {
+    buffer[c].resize(buffer[c].size() + half, 0.0f);
+  }
+  generate(output);
+}
+
+void Resampler::generate(std::vector<std::int16_t>& output)
+{
+  std::int64_t bufferEnd = bufferStart + std::int64_t(buffer[0].size());
+  std::int64_t totalOutput = (inputFrames * up + down - 1) / down;
+  while (base + half < bufferEnd && outputFrames < totalOutput) {
+    std::uint64_t row = (numPhases == up) ? phase : (phase * numPhases + up / 2) / up;
+    const float* coef = &table[row * taps];
+    for (int c = 0; c < channels; c++) {
+      const float* x = &buffer[c][base - bufferStart - half + 1];
+      // Independent partial sums give the compiler room to vectorize while
+      // keeping the summation order, and so the output, fixed.
+      float sums[4] = { 0, 0, 0, 0 };
+      for (int k = 0; k < taps; k += 4) {
+        sums[0] += x[k] * coef[k];
+        sums[1] += x[k + 1] * coef[k + 1];
+        sums[2] += x[k + 2] * coef[k + 2];
+        sums[3] += x[k + 3] * coef[k + 3];
+      }
+      float sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+      output.push_back(clamp<int>(std::lround(sum), -0x8000, 0x7FFF));
+    }
+    ++outputFrames;
+    phase += down;
+    base += phase / up;
+    phase %= up;
+  }
+
+  // Drop input that no future output frame can reach.
+  std::int64_t keepFrom = base - half + 1;
+  if (keepFrom > bufferStart) {
+    std::int64_t drop = keepFrom - bufferStart;
+    for (int c = 0; c < channels; c++) {
+      buffer[c].erase(buffer[c].begin(), buffer[c].begin() + drop);
+    }
+    bufferStart = keepFrom;
+  }
+}
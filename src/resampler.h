@@ -0,0 +1,47 @@
+#ifndef NW_RESAMPLER_H
+#define NW_RESAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+// Converts interleaved 16-bit audio between sample rates with a polyphase
+// windowed-sinc filter. Input can be supplied in blocks of any size; the
+// output is continuous across blocks and lines up with the input, without
+// any added delay.
+class Resampler
+{
+public:
+  Resampler(std::uint32_t inputRate, std::uint32_t outputRate, int channels = 2);
+
+  inline bool isPassthrough() const { return up == down; }
+
+  // Appends the output for the specified input frames to output.
+  void process(const std::int16_t* input, int frames, std::vector<std::int16_t>& output);
+
+  // Appends the remaining output once all of the input has been processed.
+  void flush(std::vector<std::int16_t>& output);
+
+  // Zero crossings of the sinc on each side of the center at full bandwidth.
+  static constexpr int ZERO_CROSSINGS = 16;
+  // Ratios with more phases than this round to the nearest of this many.
+  static constexpr int MAX_PHASES = 1024;
+
+private:
+  void buildTable();
+  void generate(std::vector<std::int16_t>& output);
+
+  int channels;
+  std::uint64_t up, down;
+  int half, taps;
+  std::uint64_t numPhases;
+  std::vector<float> table;
+
+  std::vector<float> buffer[2];
+  std::int64_t bufferStart;
+  std::int64_t base;
+  std::uint64_t phase;
+  std::int64_t inputFrames;
+  std::int64_t outputFrames;
+};
+
+#endif
@@ -34,22 +34,29 @@ RBNKFile::RBNKFile(std::istream& is, const NWChunk::ChunkInit& init)
   auto data = section('DATA');
   std::uint32_t numPrograms = data->parseU32(0);
   std::uint32_t offset = 4;
+  programs.resize(numPrograms);
   for (int i = 0; i < numPrograms; i++, offset += 8) {
     DataRef ref = data->parseDataRef(offset);
-    programs.push_back({ readKeySplits(data, ref) });
+    Program& program = programs[i];
+    program.firstRegion = regions.size();
+    readKeySplits(data, ref);
+    program.numRegions = regions.size() - program.firstRegion;
+  }
+  for (Program& program : programs) {
+    compileProgram(program);
   }
 }
 
-std::vector<RBNKFile::VelSplit> RBNKFile::readVelSplits(NWChunk* data, DataRef ref)
+void RBNKFile::readVelSplits(NWChunk* data, DataRef ref, std::uint8_t minKey, std::uint8_t maxKey)
 {
   std::uint32_t offset = ref.pointer;
   if (ref.dataType == 0 || ref.dataType > 3) {
-    return {};
+    return;
   }
   if (ref.dataType != 3) {
-    return { VelSplit{ 0, 128, Sample(data, offset) } };
+    regions.push_back({ minKey, maxKey, 0, 127, Sample(data, offset) });
+    return;
   }
-  std::vector<VelSplit> splits;
   std::uint8_t minVel = data->parseU8(offset);
   std::uint8_t maxVel = data->parseU8(offset + 1);
   offset += 4;
@@ -57,61 +64,103 @@ std::vector<RBNKFile::VelSplit> RBNKFile::readVelSplits(NWChunk* data, DataRef r
   for (std::uint8_t i = minVel; i <= maxVel; i++, offset += 8) {
     DataRef ref = data->parseDataRef(offset);
     if (ref.pointer != prev) {
-      splits.push_back({ i, i, Sample(data, ref.pointer) });
+      regions.push_back({ minKey, maxKey, i, i, Sample(data, ref.pointer) });
       prev = ref.pointer;
     } else {
-      splits.back().maxVel = i;
+      regions.back().maxVel = i;
+    }
+    if (i == 0xFF) {
+      break;
     }
   }
-  return splits;
 }
 
-std::vector<RBNKFile::KeySplit> RBNKFile::readKeySplits(NWChunk* data, DataRef ref)
+void RBNKFile::readKeySplits(NWChunk* data, DataRef ref)
 {
   if (ref.dataType == 0 || ref.dataType > 3) {
-    return {};
+    return;
   } else if (ref.dataType != 2) {
-    return { KeySplit{ 0, 127, readVelSplits(data, ref) } };
+    readVelSplits(data, ref, 0, 127);
+    return;
   }
   std::uint32_t offset = ref.pointer;
-  std::uint8_t minKey = 0;
   std::uint8_t numSplits = data->parseU8(offset++);
-  std::vector<KeySplit> splits;
+  std::uint8_t maxKeys[256];
   for (int i = 0; i < numSplits; i++) {
-    KeySplit split;
-    split.minKey = minKey;
-    split.maxKey = data->parseU8(offset++);
-    splits.push_back(split);
-    minKey = split.maxKey + 1;
+    maxKeys[i] = data->parseU8(offset++);
   }
   if (offset & 0x3) {
     offset = (offset | 0x3) + 1;
   }
+  std::uint8_t minKey = 0;
   for (int i = 0; i < numSplits; i++) {
-    KeySplit& split = splits[i];
     DataRef ref2 = data->parseDataRef(offset);
-    split.velSplits = readVelSplits(data, ref2);
+    readVelSplits(data, ref2, minKey, maxKeys[i]);
+    minKey = maxKeys[i] + 1;
     offset += 8;
   }
-  return splits;
 }
 
-const RBNKFile::Sample* RBNKFile::getSample(int program, int key, int vel) const
+void RBNKFile::compileProgram(Program& program)
 {
-  if (program < 0 || program >= programs.size()) {
-    return nullptr;
+  // Velocity band boundaries are the points where any region starts or ends.
+  bool boundary[129] = { true };
+  for (std::uint32_t i = 0; i < program.numRegions; i++) {
+    const Region& region = regions[program.firstRegion + i];
+    if (region.minVel < 128) {
+      boundary[region.minVel] = true;
+    }
+    if (region.maxVel < 128) {
+      boundary[region.maxVel + 1] = true;
+    }
   }
-  const Program& p = programs[program];
-  for (const KeySplit& k : p.keySplits) {
-    if (k.minKey <= key && key <= k.maxKey) {
-      for (const VelSplit& v : k.velSplits) {
-        if (v.minVel <= vel && vel <= v.maxVel) {
-          return &v.sample;
+  std::uint8_t bandStart[128];
+  int numBands = 0;
+  for (int vel = 0; vel < 128; vel++) {
+    if (boundary[vel]) {
+      bandStart[numBands++] = vel;
+    }
+    program.velBand[vel] = numBands - 1;
+  }
+  program.numBands = numBands;
+  program.tableOffset = regionTable.size();
+  regionTable.resize(regionTable.size() + 128 * numBands, NoRegion);
+
+  std::uint16_t* table = regionTable.data() + program.tableOffset;
+  for (int key = 0; key < 128; key++) {
+    for (int band = 0; band < numBands; band++) {
+      int vel = bandStart[band];
+      for (std::uint32_t i = 0; i < program.numRegions; i++) {
+        const Region& region = regions[program.firstRegion + i];
+        if (region.minKey <= key && key <= region.maxKey && region.minVel <= vel && vel <= region.maxVel) {
+          table[key * numBands + band] = program.firstRegion + i;
+          break;
         }
       }
     }
   }
-  return nullptr;
+}
+
+const RBNKFile::Sample* RBNKFile::getSample(int program, int key, int vel) const
+{
+  int region = findRegion(program, key, vel);
+  if (region < 0) {
+    return nullptr;
+  }
+  return &regions[region].sample;
+}
+
+int RBNKFile::findRegion(int program, int key, int vel) const
+{
+  if (program < 0 || program >= programs.size() || key < 0 || key > 127 || vel < 0 || vel > 127) {
+    return -1;
+  }
+  const Program& p = programs[program];
+  std::uint16_t region = regionTable[p.tableOffset + key * p.numBands + p.velBand[vel]];
+  if (region == NoRegion) {
+    return -1;
+  }
+  return region;
 }
 
 // for DAW plugins
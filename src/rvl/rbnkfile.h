@@ -36,30 +36,41 @@ public:
   };
 
   const Sample* getSample(int program, int key, int vel) const;
+  // Returns the index in regions of the region that plays the note, or -1.
+  int findRegion(int program, int key, int vel) const;
 
   void registerInstruments(SynthContext* synth, RWARFile* war);
 
-  struct VelSplit {
+  // A key/velocity zone of a program, mapped to a single sample.
+  struct Region {
+    std::uint8_t minKey;
+    std::uint8_t maxKey;
     std::uint8_t minVel;
     std::uint8_t maxVel;
     Sample sample;
   };
 
-  struct KeySplit {
-    std::uint8_t minKey;
-    std::uint8_t maxKey;
-    std::vector<VelSplit> velSplits;
-  };
-
+  // Programs are compiled at load time into a table indexed by key and
+  // velocity band, so finding the region for a note is a single lookup.
   struct Program {
-    std::vector<KeySplit> keySplits;
+    std::uint32_t firstRegion;
+    std::uint32_t numRegions;
+    std::uint32_t tableOffset;
+    std::uint8_t numBands;
+    std::uint8_t velBand[128];
   };
 
+  std::vector<Region> regions;
   std::vector<Program> programs;
 
 private:
-  static std::vector<VelSplit> readVelSplits(NWChunk* data, DataRef ref);
-  static std::vector<KeySplit> readKeySplits(NWChunk* data, DataRef ref);
+  static constexpr std::uint16_t NoRegion = 0xFFFF;
+
+  void readVelSplits(NWChunk* data, DataRef ref, std::uint8_t minKey, std::uint8_t maxKey);
+  void readKeySplits(NWChunk* data, DataRef ref);
+  void compileProgram(Program& program);
+
+  std::vector<std::uint16_t> regionTable;
 };
 
 #endif
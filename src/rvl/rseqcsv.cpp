@@ -4,11 +4,11 @@
 #include <fstream>
 #include <iomanip>
 
-int generateCsv(RSEQFile* file, const std::string& filename)
+int generateCsv(RSEQFile* file, const std::string& filename, std::ostream& err)
 {
   std::ofstream o(filename, std::ios::out | std::ios::trunc);
   if (!o) {
-    std::cerr << "Unable to open \"" << filename << "\" for writing" << std::endl;
+    err << "Unable to open \"" << filename << "\" for writing" << std::endl;
     return 1;
   }
 
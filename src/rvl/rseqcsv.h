@@ -1,9 +1,10 @@
 #ifndef NW_RSEQCSV_H
 #define NW_RSEQCSV_H
 
+#include <iostream>
 #include <string>
 #include "rseqfile.h"
 
-int generateCsv(RSEQFile* seq, const std::string& filename);
+int generateCsv(RSEQFile* seq, const std::string& filename, std::ostream& err = std::cerr);
 
 #endif
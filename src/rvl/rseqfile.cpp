@@ -4,6 +4,7 @@
 #include "rwarfile.h"
 #include "clefcontext.h"
 #include "nwinstrument.h"
+#include "panlaw.h"
 #include "utility.h"
 
 RSEQFile::RSEQFile(std::istream& is, const ChunkInit& init)
@@ -26,7 +27,6 @@ RSEQFile::RSEQFile(std::istream& is, const ChunkInit& init)
       maxLen = len;
     }
   }
-  std::cout << "maxlen " << maxLen << std::endl;
   for (auto& src : tracks) {
     src->maxTimestamp = maxLen;
   }
@@ -46,11 +46,34 @@ ISequence* RSEQFile::sequence()
   return this;
 }
 
-void RSEQFile::loadBank(SynthContext* synth, RBNKFile* bank, RWARFile* war)
+void RSEQFile::loadBank(SynthContext* synth, RBNKFile* bank, RWARFile* war, VoicePool* voices, int channelPriority, PanCurve panCurve)
 {
   this->bank = bank;
   this->war = war;
+  const PanLaw* panLaw = PanLaw::get(panCurve);
   for (auto& track : tracks) {
-    track->inst = NWInstrument(synth, bank, war);
+    track->inst = NWInstrument(synth, bank, war, 0, voices, channelPriority, panLaw);
+  }
+}
+
+void RSEQFile::setWindow(double start)
+{
+  for (auto& track : tracks) {
+    track->setWindow(start);
+  }
+}
+
+void RSEQFile::setAudibility(double level, double holdTime)
+{
+  for (auto& track : tracks) {
+    track->inst.audibleLevel = level;
+    track->inst.audibleHold = holdTime;
+  }
+}
+
+void RSEQFile::setWorkingSet(WorkingSet* workingSet)
+{
+  for (auto& track : tracks) {
+    track->inst.workingSet = workingSet;
   }
 }
@@ -4,6 +4,7 @@
 #include "seqfile.h"
 #include "rseqtrack.h"
 #include "seq/isequence.h"
+#include "infochunk.h"
 
 class ClefContext;
 class SynthContext;
@@ -11,6 +12,8 @@ class ISequence;
 class ITrack;
 class RBNKFile;
 class RWARFile;
+class VoicePool;
+class WorkingSet;
 
 class RSEQFile : public SEQFile, private BaseSequence<RSEQTrack>
 {
@@ -25,10 +28,22 @@ public:
 
   std::string label(int index) const;
 
-  void loadBank(SynthContext* synth, RBNKFile* bank, RWARFile* war);
+  void loadBank(SynthContext* synth, RBNKFile* bank, RWARFile* war, VoicePool* voices = nullptr, int channelPriority = 64,
+      PanCurve panCurve = _PanCurve::SQRT);
 
   ISequence* sequence() override;
 
+  // Starts every track partway through the sequence. See SEQTrack::setWindow().
+  void setWindow(double start);
+
+  // While set, notes are added to the working set instead of being played.
+  // See WorkingSet::scan().
+  void setWorkingSet(WorkingSet* workingSet);
+
+  // Sets the audibility threshold of every track's instrument, after
+  // loadBank(). See NWInstrument::audibleLevel.
+  void setAudibility(double level, double holdTime);
+
 private:
   RBNKFile* bank;
   RWARFile* war;
@@ -1,5 +1,6 @@
 #include "rseqtrack.h"
 #include "rseqfile.h"
+#include "nwvoice.h"
 #include "utility.h"
 #include "seq/sequenceevent.h"
 #include "synth/sampler.h"
@@ -214,8 +215,14 @@ RSEQTrack::RSEQEvent RSEQTrack::readEvent()
       break;
     case RSEQCmd::Extended:
       event.cmd = RSEQCmd::ExtendedBase + readByte();
-      event.param1 = readByte();
-      event.param2 = readS16();
+      if (event.cmd >= RSEQCmd::Mod2Curve && event.cmd <= RSEQCmd::Mod4Range) {
+        event.param1 = readByte();
+      } else if (event.cmd >= RSEQCmd::UserProc) {
+        event.param1 = readS16();
+      } else {
+        event.param1 = readByte();
+        event.param2 = readS16();
+      }
       break;
     case RSEQCmd::PrefixRand:
       event.param1 = readS16();
@@ -252,6 +259,30 @@ RSEQTrack::RSEQEvent RSEQTrack::readEvent()
   return event;
 }
 
+void RSEQTrack::setModParam(LfoParams& lfo, int cmd, std::int32_t value)
+{
+  switch (cmd) {
+  case RSEQCmd::ModDepth:
+    lfo.depth = value / 128.0;
+    break;
+  case RSEQCmd::ModSpeed:
+    lfo.speed = value * 0.390625; // 100/256 Hz
+    break;
+  case RSEQCmd::ModType:
+    lfo.target = value;
+    break;
+  case RSEQCmd::ModRange:
+    lfo.range = value;
+    break;
+  case RSEQCmd::ModCurve:
+    lfo.curve = value;
+    break;
+  case RSEQCmd::ModPhase:
+    lfo.phase = value / 128.0;
+    break;
+  }
+}
+
 SequenceEvent* RSEQTrack::translateEvent(std::int32_t& i, int loopCount)
 {
   if (i >= events.size()) {
@@ -312,14 +343,19 @@ SequenceEvent* RSEQTrack::translateEvent(std::int32_t& i, int loopCount)
     e->timestamp = timestamp;
     return e;
   } else if (event.cmd == RSEQCmd::Pan) {
-    ChannelEvent* e = new ChannelEvent(AudioNode::Pan, event.param1 / 128.0);
+    // Pan is applied by each voice through the sound's pan curve, not by the
+    // channel, so it goes to the voices' balance as a modulator.
+    ModulatorEvent* e = new ModulatorEvent(NWVoice::Balance, event.param1 / 128.0);
     e->timestamp = timestamp;
+    e->transitionDuration = 0;
     double current = inst.pan.valueAt(timestamp);
+    if (current < 0) {
+      current = 0.5;
+    }
     inst.pan = event.param1 / 128.0;
     for (const auto& prefix : event.prefix) {
       if (prefix.cmd == RSEQCmd::PrefixTime) {
         double end = seqFile->ticksToTimestamp(event.timestamp + prefix.param1 + loopCount * (loopEndTicks - loopStartTicks));
-        e->transition = AudioParam::Linear;
         e->transitionDuration = end - timestamp;
         inst.pan.startLevel = current;
         inst.pan.startTime = timestamp;
@@ -352,6 +388,9 @@ SequenceEvent* RSEQTrack::translateEvent(std::int32_t& i, int loopCount)
   } else if (event.cmd == RSEQCmd::Tie) {
     inst.tie = event.param1;
     return nullptr;
+  } else if (event.cmd == RSEQCmd::Priority) {
+    inst.priority = event.param1;
+    return nullptr;
   } else if (event.cmd < 0x80) {
     double start = timestamp;
     double end = seqFile->ticksToTimestamp(event.timestamp + event.param2 + loopCount * (loopEndTicks - loopStartTicks));
@@ -360,6 +399,58 @@ SequenceEvent* RSEQTrack::translateEvent(std::int32_t& i, int loopCount)
   } else if (event.cmd == RSEQCmd::Rest) {
     // ignore, already handled
     return nullptr;
+  } else if (event.cmd == RSEQCmd::BiquadType) {
+    recordBusEvent(timestamp, BusEvent::BiquadType, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::BiquadValue) {
+    recordBusEvent(timestamp, BusEvent::BiquadValue, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::Cutoff) {
+    recordBusEvent(timestamp, BusEvent::Cutoff, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::SendA) {
+    recordBusEvent(timestamp, BusEvent::SendA, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::SendB) {
+    recordBusEvent(timestamp, BusEvent::SendB, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::SendC) {
+    recordBusEvent(timestamp, BusEvent::SendC, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::MainSend) {
+    recordBusEvent(timestamp, BusEvent::MainSend, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::Portamento) {
+    inst.portaKey = event.param1 + transpose;
+    inst.portamento = true;
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::PortaEnable) {
+    inst.portamento = event.param1;
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::PortaTime) {
+    inst.portaTime = event.param1;
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::Sweep) {
+    inst.sweep = event.param1 / 64.0;
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::ModDepth || event.cmd == RSEQCmd::ModSpeed || event.cmd == RSEQCmd::ModType ||
+      event.cmd == RSEQCmd::ModRange || event.cmd == RSEQCmd::ModCurve || event.cmd == RSEQCmd::ModPhase) {
+    setModParam(inst.modulation.lfo[0], event.cmd, event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::ModDelay) {
+    inst.modulation.lfo[0].delay = event.param1 * 0.005;
+    return nullptr;
+  } else if (event.cmd >= RSEQCmd::Mod2Curve && event.cmd <= RSEQCmd::Mod4Range) {
+    // Mod2 through Mod4 each have a block of six commands in the same order.
+    int offset = event.cmd - RSEQCmd::Mod2Curve;
+    static const std::uint16_t mod1Cmds[] = {
+      RSEQCmd::ModCurve, RSEQCmd::ModPhase, RSEQCmd::ModDepth, RSEQCmd::ModSpeed, RSEQCmd::ModType, RSEQCmd::ModRange,
+    };
+    setModParam(inst.modulation.lfo[offset / 6 + 1], mod1Cmds[offset % 6], event.param1);
+    return nullptr;
+  } else if (event.cmd == RSEQCmd::Mod2Delay || event.cmd == RSEQCmd::Mod3Delay || event.cmd == RSEQCmd::Mod4Delay) {
+    inst.modulation.lfo[(event.cmd - RSEQCmd::Mod2Delay) / 2 + 1].delay = event.param1 * 0.005;
+    return nullptr;
   } else if (event.cmd >= 0xCA && event.cmd <= 0xE0) {
     // no-op for now
     return nullptr;
@@ -156,6 +156,7 @@ protected:
 
 private:
   RSEQEvent readEvent();
+  static void setModParam(LfoParams& lfo, int cmd, std::int32_t value);
 
   RSEQFile* file;
   std::uint32_t tickPos;
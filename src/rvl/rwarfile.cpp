@@ -1,8 +1,11 @@
 #include "rwarfile.h"
 #include "rwavfile.h"
+#include "samplecache.h"
+#include "clefcontext.h"
+#include "codec/sampledata.h"
 
 RWARFile::RWARFile(std::istream& is, const ChunkInit& init)
-: NWFile(is, init)
+: NWFile(is, init), sampleCache(nullptr), directADPCM(false)
 {
   readRHeader(is);
 
@@ -12,6 +15,9 @@ RWARFile::RWARFile(std::istream& is, const ChunkInit& init)
   for (int i = 0; i < numWaves; i++, pos += 12) {
     entries.push_back({ tabl->parseDataRef(pos), tabl->parseU32(pos + 8) });
   }
+  waves.resize(entries.size());
+  hashes.assign(entries.size(), 0);
+  formats.assign(entries.size(), -1);
 }
 
 viewstream RWARFile::getFile(int index, bool) const
@@ -34,11 +40,134 @@ RWAVFile* RWARFile::getRWAV(int index) const
   return NWChunk::load<RWAVFile>(stream, nullptr, ctx);
 }
 
-SampleData* RWARFile::getSample(int index) const
+const RWAVFile* RWARFile::adopt(int index, std::unique_ptr<RWAVFile>& rwav, bool keep) const
 {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (rwav && formats[index] < 0) {
+    formats[index] = rwav->format;
+    hashes[index] = rwav->contentHash();
+  }
+  if (keep && rwav && !waves[index]) {
+    waves[index] = std::move(rwav);
+  }
+  return waves[index].get();
+}
+
+const RWAVFile* RWARFile::resident(int index) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return waves[index].get();
+}
+
+const RWAVFile* RWARFile::wave(int index) const
+{
+  if (index < 0 || index >= entries.size()) {
+    return nullptr;
+  }
+  if (const RWAVFile* rwav = resident(index)) {
+    return rwav;
+  }
+  // Parsed outside of the lock so that other waves can be parsed and decoded
+  // in the meantime. If two threads parse the same wave, the first one wins.
   std::unique_ptr<RWAVFile> rwav(getRWAV(index));
+  return adopt(index, rwav, true);
+}
+
+void RWARFile::setDirectADPCM(bool enable)
+{
+  directADPCM = enable;
+}
+
+bool RWARFile::playsDirect(int index) const
+{
+  if (!directADPCM || index < 0 || index >= entries.size()) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (formats[index] >= 0) {
+      return formats[index] == RWAVFile::ADPCM;
+    }
+  }
+  std::unique_ptr<RWAVFile> rwav(getRWAV(index));
+  bool direct = rwav && rwav->format == RWAVFile::ADPCM;
+  adopt(index, rwav, direct);
+  return direct;
+}
+
+void RWARFile::setSampleCache(SampleCache* cache)
+{
+  sampleCache = cache;
+}
+
+std::uint64_t RWARFile::waveHash(int index) const
+{
+  if (index < 0 || index >= entries.size()) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (formats[index] >= 0) {
+      return hashes[index];
+    }
+  }
+  std::unique_ptr<RWAVFile> rwav(getRWAV(index));
+  adopt(index, rwav, false);
+  std::lock_guard<std::mutex> lock(mutex);
+  return hashes[index];
+}
+
+SampleData* RWARFile::getSample(int index) const
+{
+  if (index < 0 || index >= entries.size()) {
+    return nullptr;
+  }
+  if (!sampleCache) {
+    SampleData* sample = ctx->getSample(index);
+    if (sample) {
+      return sample;
+    }
+    if (const RWAVFile* rwav = resident(index)) {
+      return rwav->sample(index);
+    }
+    std::unique_ptr<RWAVFile> rwav(getRWAV(index));
+    if (!rwav) {
+      return nullptr;
+    }
+    return rwav->sample(index);
+  }
+
+  // The wave is parsed to be hashed, and that parse is kept until the
+  // sample is decoded from it on a miss, so a miss parses only once.
+  std::unique_ptr<RWAVFile> parsed;
+  bool hashed;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    hashed = formats[index] >= 0;
+  }
+  if (!hashed) {
+    parsed.reset(getRWAV(index));
+    adopt(index, parsed, false);
+  }
+  std::uint64_t key = waveHash(index);
+  SampleData* sample = sampleCache->find(key);
+  if (!sample) {
+    sample = sampleCache->load(ctx, key);
+  }
+  if (sample) {
+    return sample;
+  }
+  const RWAVFile* rwav = parsed ? parsed.get() : resident(index);
+  if (!rwav) {
+    parsed.reset(getRWAV(index));
+    rwav = parsed.get();
+  }
   if (!rwav) {
     return nullptr;
   }
-  return rwav->sample(index);
+  sample = rwav->sample(SampleData::Uncached);
+  if (!sample) {
+    return nullptr;
+  }
+  return sampleCache->insert(key, sample);
 }
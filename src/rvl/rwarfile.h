@@ -2,9 +2,11 @@
 #define NW_RWARFILE_H
 
 #include "nwfile.h"
+#include "rwavfile.h"
+#include <mutex>
 
 class SampleData;
-class RWAVFile;
+class SampleCache;
 
 class RWARFile : public NWFile
 {
@@ -19,12 +21,40 @@ public:
   SampleData* getSample(int index) const;
   RWAVFile* getRWAV(int index) const;
 
+  // Parses the wave the first time it is asked for and keeps it in memory.
+  // Only waves that are played from their encoded form need to stay parsed.
+  const RWAVFile* wave(int index) const;
+
+  // When enabled, ADPCM waves are played from their encoded form instead of
+  // being decoded to PCM ahead of time.
+  void setDirectADPCM(bool enable);
+  bool playsDirect(int index) const;
+
+  // Decoded samples are then looked up in the cache by content instead of by
+  // index. Each wave is parsed and hashed the first time it is looked up,
+  // and only decoded if the cache doesn't have it.
+  void setSampleCache(SampleCache* cache);
+  std::uint64_t waveHash(int index) const;
+
 private:
   struct Entry {
     DataRef offset;
     std::uint32_t size;
   };
+  // Records what is learned from parsing a wave, keeping the parse if it
+  // should stay in memory, and returns the resident parse if there is one.
+  const RWAVFile* adopt(int index, std::unique_ptr<RWAVFile>& rwav, bool keep) const;
+  const RWAVFile* resident(int index) const;
+
   std::vector<Entry> entries;
+
+  // Filled in as waves are used, from any thread.
+  mutable std::mutex mutex;
+  mutable std::vector<std::unique_ptr<RWAVFile>> waves;
+  mutable std::vector<std::uint64_t> hashes;
+  mutable std::vector<std::int8_t> formats; // -1 until parsed
+  SampleCache* sampleCache;
+  bool directADPCM;
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include "dspadpcmcodec.h"
 #include "codec/sampledata.h"
 #include "codec/pcmcodec.h"
+#include "contenthash.h"
 
 RWAVFile::RWAVFile(std::istream& is, const ChunkInit& init)
 : NWFile(is, init)
@@ -47,7 +48,46 @@ RWAVFile::RWAVFile(std::istream& is, const ChunkInit& init)
   }
 }
 
-SampleData* RWAVFile::sample(std::uint64_t sampleID)
+std::uint32_t RWAVFile::encodedLength() const
+{
+  if (format == ADPCM) {
+    return loopEnd / 2;
+  } else if (format == PCM16) {
+    return loopEnd * 2;
+  }
+  return loopEnd;
+}
+
+std::uint64_t RWAVFile::contentHash() const
+{
+  ContentHash hash;
+  hash.add<std::uint8_t>(format);
+  hash.add<std::uint8_t>(looped);
+  hash.add<std::uint8_t>(isLittleEndian);
+  hash.add(sampleRate);
+  hash.add(loopStart);
+  hash.add(loopEnd);
+  hash.add<std::uint32_t>(channels.size());
+
+  NWChunk* data = section('DATA');
+  std::uint32_t dataLength = encodedLength();
+  for (const ChannelInfo& ch : channels) {
+    if (format == ADPCM) {
+      hash.update(ch.adpcm.coef, sizeof(ch.adpcm.coef));
+      hash.add(ch.adpcm.history1);
+      hash.add(ch.adpcm.history2);
+      hash.add(ch.adpcm.loopPred);
+      hash.add(ch.adpcm.loopHistory1);
+      hash.add(ch.adpcm.loopHistory2);
+    }
+    if (data && ch.sampleOffset + dataLength <= data->rawData.size()) {
+      hash.update(data->rawData.data() + ch.sampleOffset, dataLength);
+    }
+  }
+  return hash.digest();
+}
+
+SampleData* RWAVFile::sample(std::uint64_t sampleID) const
 {
   int numChannels = channels.size();
   SampleData* combined = nullptr;
@@ -68,16 +108,13 @@ SampleData* RWAVFile::sample(std::uint64_t sampleID)
         params.coefs[i] = ch.adpcm.coef[i];
       }
       DspAdpcmCodec codec(ctx, params);
-      std::uint32_t dataLength = loopEnd / 2;
+      std::uint32_t dataLength = encodedLength();
       auto begin = data->rawData.begin() + ch.sampleOffset;
       decoded = codec.decodeRange(begin, begin + dataLength, setSampleID);
     } else {
       PcmCodec codec(ctx, format == PCM8 ? 8 : 16, 1, !isLittleEndian);
       auto begin = data->rawData.begin() + ch.sampleOffset;
-      std::uint32_t dataLength = loopEnd;
-      if (format == PCM16) {
-        dataLength *= 2;
-      }
+      std::uint32_t dataLength = encodedLength();
       decoded = codec.decodeRange(begin, begin + dataLength, setSampleID);
       decoded->loopStart = loopStart;
       decoded->loopEnd = loopEnd;
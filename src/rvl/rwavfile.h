@@ -13,7 +13,11 @@ protected:
   RWAVFile(std::istream& is, const ChunkInit& init);
 
 public:
-  SampleData* sample(std::uint64_t sampleID);
+  SampleData* sample(std::uint64_t sampleID) const;
+
+  // Identifies the wave by its encoded data and decoding parameters, so that
+  // identical waves in different archives share a single decoded sample.
+  std::uint64_t contentHash() const;
 
   enum Format {
     PCM8,
@@ -47,6 +51,9 @@ public:
     std::uint32_t surroundRightVolume;
   };
   std::vector<ChannelInfo> channels;
+
+private:
+  std::uint32_t encodedLength() const;
 };
 
 #endif
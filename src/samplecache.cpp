@@ -0,0 +1,148 @@
+#include "samplecache.h"
+#include "codec/sampledata.h"
+
+SampleCache::SampleCache(std::size_t budgetBytes)
+: hits(0), misses(0), evictions(0), diskHits(0), diskWrites(0), budgetBytes(budgetBytes), totalBytes(0), generation(0)
+{
+  // initializers only
+}
+
+SampleCache::~SampleCache()
+{
+  // members clean up after themselves
+}
+
+std::size_t SampleCache::sampleBytes(const SampleData* sample)
+{
+  std::size_t bytes = sizeof(SampleData);
+  for (const auto& channel : sample->channels) {
+    bytes += channel.capacity() * sizeof(channel[0]);
+  }
+  return bytes;
+}
+
+SampleData* SampleCache::find(std::uint64_t key)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto iter = index.find(key);
+  if (iter == index.end()) {
+    ++misses;
+    return nullptr;
+  }
+  ++hits;
+  touch(iter->second);
+  return iter->second->sample.get();
+}
+
+SampleData* SampleCache::load(ClefContext* ctx, std::uint64_t key)
+{
+  // The disk cache is set up before any rendering starts, so it can be read
+  // without holding the lock, and lookups from other threads don't wait on
+  // the disk.
+  if (!disk) {
+    return nullptr;
+  }
+  SampleData* sample = disk->load(ctx, key);
+  if (!sample) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  ++diskHits;
+  return insertEntry(key, sample);
+}
+
+SampleData* SampleCache::insert(std::uint64_t key, SampleData* sample)
+{
+  bool store = false;
+  if (disk) {
+    std::lock_guard<std::mutex> lock(mutex);
+    store = !index.count(key);
+  }
+  // Written outside of the lock, like load(). Two threads that decoded the
+  // same wave may both write it, which is harmless since each blob is
+  // renamed into place whole.
+  bool stored = store && disk->store(key, sample);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stored) {
+    ++diskWrites;
+  }
+  return insertEntry(key, sample);
+}
+
+void SampleCache::setDiskCache(std::unique_ptr<PcmDiskCache> diskCache)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  disk = std::move(diskCache);
+}
+
+SampleData* SampleCache::insertEntry(std::uint64_t key, SampleData* sample)
+{
+  auto iter = index.find(key);
+  if (iter != index.end()) {
+    delete sample;
+    touch(iter->second);
+    return iter->second->sample.get();
+  }
+
+  std::size_t bytes = sampleBytes(sample);
+  lru.push_front({ key, std::unique_ptr<SampleData>(sample), bytes, generation });
+  index[key] = lru.begin();
+  totalBytes += bytes;
+  evict();
+  return sample;
+}
+
+std::uint64_t SampleCache::beginSequence()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  ++generation;
+  activeSequences.insert(generation);
+  evict();
+  return generation;
+}
+
+void SampleCache::endSequence(std::uint64_t token)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto iter = activeSequences.find(token);
+  if (iter != activeSequences.end()) {
+    activeSequences.erase(iter);
+  }
+}
+
+void SampleCache::setBudget(std::size_t budgetBytes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->budgetBytes = budgetBytes;
+  evict();
+}
+
+void SampleCache::touch(std::list<Entry>::iterator iter)
+{
+  iter->generation = generation;
+  if (iter != lru.begin()) {
+    lru.splice(lru.begin(), lru, iter);
+  }
+}
+
+void SampleCache::evict()
+{
+  if (!budgetBytes) {
+    return;
+  }
+  // Entries are stamped with the newest generation when they are used, so
+  // anything at or after the oldest active sequence may still be playing.
+  std::uint64_t protect = activeSequences.empty() ? generation : *activeSequences.begin();
+  auto iter = lru.end();
+  while (totalBytes > budgetBytes && iter != lru.begin()) {
+    --iter;
+    if (iter->generation >= protect) {
+      // Everything from here forward is in use by an active sequence.
+      break;
+    }
+    totalBytes -= iter->bytes;
+    index.erase(iter->key);
+    iter = lru.erase(iter);
+    ++evictions;
+  }
+}
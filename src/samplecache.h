@@ -0,0 +1,81 @@
+#ifndef NW_SAMPLECACHE_H
+#define NW_SAMPLECACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "pcmdiskcache.h"
+class SampleData;
+class ClefContext;
+
+// Process-wide store of decoded samples with a memory budget and LRU eviction.
+// Unlike the ClefContext sample cache, this outlives individual sequences and
+// input files, so waves that are shared between them are only decoded once.
+// Lookups and insertions are safe to call from multiple rendering threads.
+class SampleCache
+{
+public:
+  SampleCache(std::size_t budgetBytes = 0);
+  ~SampleCache();
+
+  // Returns nullptr (and counts a miss) if the key is not present.
+  SampleData* find(std::uint64_t key);
+
+  // Tries the on-disk cache, if one is configured, after a miss in memory.
+  SampleData* load(ClefContext* ctx, std::uint64_t key);
+
+  // Takes ownership of the sample. Returns the sample that ended up in the
+  // cache, which is the existing one if the key was already present.
+  // Newly decoded samples are also written to the on-disk cache.
+  SampleData* insert(std::uint64_t key, SampleData* sample);
+
+  // Must be called before the cache is used from more than one thread.
+  void setDiskCache(std::unique_ptr<PcmDiskCache> diskCache);
+  inline const PcmDiskCache* diskCache() const { return disk.get(); }
+
+  // Samples used since the oldest sequence that has not yet ended began may
+  // still be referenced by active voices and are never evicted. Sequences
+  // rendered at the same time each hold their own token.
+  std::uint64_t beginSequence();
+  void endSequence(std::uint64_t token);
+
+  void setBudget(std::size_t budgetBytes);
+  inline std::size_t budget() const { return budgetBytes; }
+  inline std::size_t residentBytes() const { return totalBytes; }
+  inline std::size_t numSamples() const { return index.size(); }
+
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t evictions;
+  std::uint64_t diskHits;
+  std::uint64_t diskWrites;
+
+  static std::size_t sampleBytes(const SampleData* sample);
+
+private:
+  struct Entry {
+    std::uint64_t key;
+    std::unique_ptr<SampleData> sample;
+    std::size_t bytes;
+    std::uint64_t generation;
+  };
+
+  SampleData* insertEntry(std::uint64_t key, SampleData* sample);
+  void touch(std::list<Entry>::iterator iter);
+  void evict();
+
+  std::mutex mutex;
+  std::unique_ptr<PcmDiskCache> disk;
+  std::list<Entry> lru;
+  std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index;
+  std::size_t budgetBytes;
+  std::size_t totalBytes;
+  std::uint64_t generation;
+  std::multiset<std::uint64_t> activeSequences;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "seqtrack.h"
 #include "seqfile.h"
 #include "nwchunk.h"
+#include <algorithm>
 
 SEQTrack::SEQTrack(SEQFile* file, NWChunk* chunk, int trackIndex)
 : seqFile(file),
@@ -11,12 +12,14 @@ SEQTrack::SEQTrack(SEQFile* file, NWChunk* chunk, int trackIndex)
   bend(0),
   bendRange(2),
   transpose(0),
+  recordsBusEvents(false),
   loopStartTicks(-1),
   loopEndTicks(-1),
   loopStartIndex(-1),
   trackEndIndex(-1),
   trackIndex(trackIndex),
-  maxTimestamp(-1)
+  maxTimestamp(-1),
+  windowStart(0)
 {
   // initializers only
 }
@@ -107,6 +110,10 @@ std::shared_ptr<SequenceEvent> SEQTrack::readNextEvent()
         delete event;
         return nullptr;
       }
+      if (windowStart > 0 && !shiftToWindow(event)) {
+        delete event;
+        continue;
+      }
       return std::shared_ptr<SequenceEvent>(event);
     }
   }
@@ -119,12 +126,47 @@ void SEQTrack::internalReset()
   bend = 0;
   bendRange = 2;
   transpose = 0;
+  busEvents.clear();
   int numVars = seqFile->variables.size();
   for (int i = 0; i < numVars; i++) {
     seqFile->variables[i] = 0;
   }
 }
 
+void SEQTrack::setWindow(double start)
+{
+  windowStart = start > 0 ? start : 0;
+}
+
+bool SEQTrack::shiftToWindow(SequenceEvent* event) const
+{
+  if (event->timestamp < windowStart) {
+    if (dynamic_cast<BaseNoteEvent*>(event) || dynamic_cast<NoteUpdateEvent*>(event)) {
+      return false;
+    }
+    // Anything else is state that carries into the window, so it takes
+    // effect at the start with whatever remains of its transition.
+    double remaining = event->timestamp - windowStart;
+    if (ChannelEvent* e = dynamic_cast<ChannelEvent*>(event)) {
+      e->transitionDuration = std::max(0.0, e->transitionDuration + remaining);
+    } else if (ModulatorEvent* e = dynamic_cast<ModulatorEvent*>(event)) {
+      e->transitionDuration = std::max(0.0, e->transitionDuration + remaining);
+    }
+    event->timestamp = windowStart;
+  }
+  event->timestamp -= windowStart;
+  return true;
+}
+
+void SEQTrack::recordBusEvent(double timestamp, int param, int value)
+{
+  if (!recordsBusEvents) {
+    return;
+  }
+  timestamp = timestamp < windowStart ? 0 : timestamp - windowStart;
+  busEvents.push_back({ timestamp, param, value });
+}
+
 bool SEQTrack::isFinished() const
 {
   if (loopEndTicks < 0) {
@@ -144,7 +186,7 @@ double SEQTrack::length() const
   if (loopEndTicks < 0) {
     return 0;
   } else if (maxTimestamp >= 0) {
-    return maxTimestamp;
+    return std::max(0.0, maxTimestamp - windowStart);
   } else if (loopStartTicks >= 0) {
     std::int32_t loopLength = loopEndTicks - loopStartTicks;
     // TODO: coda?
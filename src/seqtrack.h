@@ -41,10 +41,42 @@ protected:
   virtual void internalReset();
   virtual SequenceEvent* translateEvent(std::int32_t& index, int loopCount) = 0;
 
+  bool shiftToWindow(SequenceEvent* event) const;
+  void recordBusEvent(double timestamp, int param, int value);
+
 public:
   virtual bool isFinished() const;
   virtual double length() const;
 
+  // Plays the track starting partway through, for rendering a sequence in
+  // segments. Notes that begin before the start of the window are dropped,
+  // other events before it take effect at the start, and timestamps are
+  // shifted so that the window starts at time 0.
+  void setWindow(double start);
+
+  // Settings that apply to the track's mixed output instead of to individual
+  // voices. They are recorded as the track is read, ahead of or at the time
+  // they take effect, for the track mixer to apply at the right frame. Only
+  // tracks with recordsBusEvents set keep them; anywhere else nothing reads
+  // them, and the list would grow for the whole song.
+  struct BusEvent {
+    enum Param {
+      BiquadType,
+      BiquadValue,
+      Cutoff,
+      SendA,
+      SendB,
+      SendC,
+      MainSend,
+    };
+
+    double timestamp;
+    int param;
+    int value;
+  };
+  std::vector<BusEvent> busEvents;
+  bool recordsBusEvents;
+
   std::int32_t loopStartTicks;
   std::int32_t loopEndTicks;
   std::int32_t loopStartIndex;
@@ -52,6 +84,7 @@ public:
   std::int32_t trackEndIndex;
   int trackIndex;
   double maxTimestamp;
+  double windowStart;
   bool finishedOnce;
 };
 
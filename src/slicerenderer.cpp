@@ -0,0 +1,227 @@
+#include "slicerenderer.h"
+#include "trackmixer.h"
+#include "seqtrack.h"
+#include "threadpool.h"
+#include "pcmsink.h"
+#include "resampler.h"
+#include "rvl/rseqfile.h"
+#include "seq/isequence.h"
+#include "seq/itrack.h"
+#include "seq/sequenceevent.h"
+#include <algorithm>
+#include <cstdlib>
+
+SliceRenderer::SliceRenderer(const Loader& load, double sampleRate, int numSegments, double overlap, ThreadPool* pool)
+: load(load), pool(pool), sampleRate(sampleRate), nextSegment(0), sink(nullptr), resampler(nullptr), keepOutput(false)
+{
+  std::vector<NoteSpan> notes;
+  double duration;
+  bool sends = false;
+  {
+    std::unique_ptr<RSEQFile> scan(load());
+    duration = scan->sequence()->duration();
+    notes = scanNotes(scan.get(), sends);
+  }
+  // Aux buses start out empty in each segment, so effects that are fed need
+  // their whole tail rendered ahead of the boundary too.
+  double preroll = overlap + (sends ? TrackMixer::MAX_TAIL : 0);
+  std::int64_t totalFrames = duration * sampleRate;
+  if (numSegments < 1) {
+    numSegments = 1;
+  }
+
+  segments.resize(numSegments);
+  for (int i = 0; i < numSegments; i++) {
+    Segment& segment = segments[i];
+    segment.startFrame = totalFrames * i / numSegments;
+    segment.endFrame = i + 1 < numSegments ? totalFrames * (i + 1) / numSegments : -1;
+    segment.frames = 0;
+    segment.finished = false;
+
+    // Start early enough to catch every note that could still be audible at
+    // the boundary, so that its voice is rendered from its first sample.
+    double boundary = segment.startFrame / sampleRate;
+    double window = boundary - preroll;
+    for (const NoteSpan& note : notes) {
+      if (note.start < window && note.end + preroll > boundary) {
+        window = note.start;
+      }
+    }
+    segment.windowFrame = window > 0 ? std::int64_t(window * sampleRate) : 0;
+    if (segment.windowFrame > segment.startFrame) {
+      segment.windowFrame = segment.startFrame;
+    }
+
+    segment.seq.reset(load());
+    if (segment.windowFrame > 0) {
+      segment.seq->setWindow(segment.windowFrame / sampleRate);
+    }
+  }
+}
+
+SliceRenderer::~SliceRenderer()
+{
+  // members clean up after themselves
+}
+
+std::vector<SliceRenderer::NoteSpan> SliceRenderer::scanNotes(RSEQFile* seq, bool& sends)
+{
+  std::vector<NoteSpan> notes;
+  ISequence* sequence = seq->sequence();
+  int numTracks = sequence->numTracks();
+  for (int i = 0; i < numTracks; i++) {
+    ITrack* track = sequence->getTrack(i);
+    SEQTrack* source = dynamic_cast<SEQTrack*>(track);
+    if (source) {
+      source->recordsBusEvents = true;
+    }
+    int lastNote = -1;
+    while (auto event = track->nextEvent()) {
+      if (auto note = std::dynamic_pointer_cast<BaseNoteEvent>(event)) {
+        lastNote = notes.size();
+        notes.push_back({ note->timestamp, note->timestamp + note->duration });
+      } else if (auto update = std::dynamic_pointer_cast<NoteUpdateEvent>(event)) {
+        // Ties extend the most recent note on the track.
+        if (lastNote >= 0) {
+          notes[lastNote].end = update->timestamp + update->newDuration;
+        }
+      }
+    }
+    if (!source) {
+      continue;
+    }
+    for (const SEQTrack::BusEvent& bus : source->busEvents) {
+      if (bus.param >= SEQTrack::BusEvent::SendA && bus.param <= SEQTrack::BusEvent::SendC && bus.value > 0) {
+        sends = true;
+      }
+    }
+    source->busEvents.clear();
+  }
+  return notes;
+}
+
+void SliceRenderer::render(PcmSink* sink, Resampler* resampler, bool keepOutput)
+{
+  this->sink = sink;
+  this->resampler = resampler;
+  this->keepOutput = keepOutput;
+  nextSegment = 0;
+  output.clear();
+
+  int numSegments = segments.size();
+  if (pool) {
+    pool->run(numSegments, [this](int i) { renderSegment(i); });
+  } else {
+    for (int i = 0; i < numSegments; i++) {
+      renderSegment(i);
+    }
+  }
+  if (resampler) {
+    resampled.clear();
+    resampler->flush(resampled);
+    sink->write(resampled);
+  }
+}
+
+void SliceRenderer::renderSegment(int index)
+{
+  Segment& segment = segments[index];
+  TrackMixer mixer(segment.seq->ctx, segment.seq->sequence(), sampleRate);
+  std::vector<std::int16_t> block(TrackMixer::BLOCK_FRAMES * 2);
+  std::vector<std::int16_t> samples;
+  std::int64_t frame = segment.windowFrame;
+  while (segment.endFrame < 0 || frame < segment.endFrame) {
+    int frames = mixer.render(block.data(), TrackMixer::BLOCK_FRAMES);
+    if (frames <= 0) {
+      break;
+    }
+    std::int64_t from = std::max(frame, segment.startFrame);
+    std::int64_t to = frame + frames;
+    if (segment.endFrame >= 0 && to > segment.endFrame) {
+      to = segment.endFrame;
+    }
+    if (to > from) {
+      samples.assign(block.begin() + (from - frame) * 2, block.begin() + (to - frame) * 2);
+      std::lock_guard<std::mutex> lock(mutex);
+      segment.frames += to - from;
+      if (nextSegment == index) {
+        write(samples);
+      } else if (nextSegment < index) {
+        segment.pending.insert(segment.pending.end(), samples.begin(), samples.end());
+      }
+    }
+    frame += frames;
+  }
+  finishSegment(index);
+}
+
+void SliceRenderer::finishSegment(int index)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  segments[index].finished = true;
+  int numSegments = segments.size();
+  while (nextSegment < numSegments && segments[nextSegment].finished) {
+    const Segment& done = segments[nextSegment];
+    if (done.endFrame >= 0 && done.frames < done.endFrame - done.startFrame) {
+      // The sequence ended early, so nothing after this segment belongs in
+      // the output.
+      nextSegment = numSegments;
+      break;
+    }
+    ++nextSegment;
+    if (nextSegment < numSegments) {
+      Segment& next = segments[nextSegment];
+      write(next.pending);
+      std::vector<std::int16_t>().swap(next.pending);
+    }
+  }
+}
+
+void SliceRenderer::write(const std::vector<std::int16_t>& samples)
+{
+  if (samples.empty()) {
+    return;
+  }
+  if (keepOutput) {
+    output.insert(output.end(), samples.begin(), samples.end());
+  }
+  if (resampler) {
+    resampled.clear();
+    resampler->process(samples.data(), samples.size() / 2, resampled);
+    sink->write(resampled);
+  } else {
+    sink->write(samples);
+  }
+}
+
+std::uint64_t SliceRenderer::verify(int* peak)
+{
+  std::unique_ptr<RSEQFile> seq(load());
+  TrackMixer mixer(seq->ctx, seq->sequence(), sampleRate, pool);
+  std::vector<std::int16_t> block(TrackMixer::BLOCK_FRAMES * 2);
+
+  std::uint64_t differences = 0;
+  *peak = 0;
+  std::size_t pos = 0;
+  while (true) {
+    int frames = mixer.render(block.data(), TrackMixer::BLOCK_FRAMES);
+    if (frames <= 0) {
+      break;
+    }
+    for (int i = 0; i < frames * 2; i++) {
+      int sliced = pos < output.size() ? output[pos++] : 0;
+      int diff = std::abs(sliced - block[i]);
+      if (diff) {
+        ++differences;
+        if (diff > *peak) {
+          *peak = diff;
+        }
+      }
+    }
+  }
+  // Anything left over in the sliced output is extra.
+  if (pos < output.size()) {
+    differences += output.size() - pos;
+  }
+  return differences;
+}
@@ -0,0 +1,81 @@
+#ifndef NW_SLICERENDERER_H
+#define NW_SLICERENDERER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+class RSEQFile;
+class PcmSink;
+class Resampler;
+class ThreadPool;
+
+// Splits a sequence into segments of time and renders them concurrently.
+// Each segment plays its own copy of the sequence, fast-forwarded to a point
+// early enough that every note still sounding at the segment boundary is
+// started from the beginning, plus an overlap for release tails. If any
+// track sends to an aux bus, the overlap also covers the longest effect
+// tail, since each segment's buses start out empty. Output before the
+// boundary is discarded and the segments are written out in order.
+class SliceRenderer
+{
+public:
+  // Returns a new copy of the sequence with its bank loaded.
+  using Loader = std::function<RSEQFile*()>;
+
+  SliceRenderer(const Loader& load, double sampleRate, int segments, double overlap, ThreadPool* pool);
+  ~SliceRenderer();
+
+  // Renders the sequence to the sink, converting it to another sample rate
+  // first if a resampler is provided. The earliest unfinished segment writes
+  // its output as it renders; later ones only hold theirs until every
+  // segment before them has finished. If keepOutput is set, the output is
+  // also kept for verify().
+  void render(PcmSink* sink, Resampler* resampler = nullptr, bool keepOutput = false);
+
+  // Renders the sequence again without slicing and compares the result with
+  // the output kept by render(). Returns the number of samples that differ
+  // and stores the largest difference.
+  std::uint64_t verify(int* peak);
+
+  inline int numSegments() const { return segments.size(); }
+
+private:
+  struct Segment {
+    std::unique_ptr<RSEQFile> seq;
+    std::int64_t windowFrame;
+    std::int64_t startFrame;
+    std::int64_t endFrame; // -1 for the last segment
+    std::int64_t frames;
+    bool finished;
+    // Output waiting for an earlier segment to finish.
+    std::vector<std::int16_t> pending;
+  };
+
+  struct NoteSpan {
+    double start;
+    double end;
+  };
+
+  static std::vector<NoteSpan> scanNotes(RSEQFile* seq, bool& sends);
+  void renderSegment(int index);
+  void finishSegment(int index);
+  void write(const std::vector<std::int16_t>& samples);
+
+  Loader load;
+  std::vector<Segment> segments;
+  ThreadPool* pool;
+  double sampleRate;
+
+  // Guards the members below, which are only used during render().
+  std::mutex mutex;
+  int nextSegment;
+  PcmSink* sink;
+  Resampler* resampler;
+  std::vector<std::int16_t> resampled;
+  bool keepOutput;
+  std::vector<std::int16_t> output;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef NW_SPSCRING_H
+#define NW_SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed-size ring of slots between exactly one producer thread and one
+// consumer thread, without locks. Slots are allocated up front and filled
+// and read in place: the producer fills back() and then push()es it, and the
+// consumer reads front() and then pop()s it. None of these block or
+// allocate, so either side can be a real-time audio thread.
+template <typename T>
+class SpscRing
+{
+public:
+  SpscRing(std::size_t capacity) : slots(capacity ? capacity + 1 : 2), head(0), tail(0) {}
+  SpscRing(const SpscRing& other) = delete;
+  SpscRing& operator=(const SpscRing& other) = delete;
+
+  // Producer only. Returns nullptr if the ring is full.
+  T* back()
+  {
+    std::size_t next = advance(tail.load(std::memory_order_relaxed));
+    if (next == head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots[tail.load(std::memory_order_relaxed)];
+  }
+
+  // Producer only. Publishes the slot returned by back().
+  void push()
+  {
+    tail.store(advance(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+  }
+
+  // Consumer only. Returns nullptr if the ring is empty.
+  T* front()
+  {
+    std::size_t pos = head.load(std::memory_order_relaxed);
+    if (pos == tail.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots[pos];
+  }
+
+  // Consumer only. Returns the slot returned by front() to the producer.
+  void pop()
+  {
+    head.store(advance(head.load(std::memory_order_relaxed)), std::memory_order_release);
+  }
+
+  inline std::size_t capacity() const { return slots.size() - 1; }
+
+private:
+  inline std::size_t advance(std::size_t pos) const { return pos + 1 == slots.size() ? 0 : pos + 1; }
+
+  // One slot is always left empty to tell a full ring from an empty one.
+  std::vector<T> slots;
+  std::atomic<std::size_t> head;
+  std::atomic<std::size_t> tail;
+};
+
+#endif
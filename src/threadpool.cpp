@@ -0,0 +1,79 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threads)
+: task(nullptr), count(0), next(0), pending(0), stopping(false)
+{
+  for (int i = 1; i < threads; i++) {
+    workers.emplace_back(&ThreadPool::worker, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& thread : workers) {
+    thread.join();
+  }
+}
+
+int ThreadPool::hardwareThreads()
+{
+  int threads = std::thread::hardware_concurrency();
+  return threads > 0 ? threads : 1;
+}
+
+void ThreadPool::run(int count, const std::function<void(int)>& task)
+{
+  if (workers.empty() || count <= 1) {
+    for (int i = 0; i < count; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  this->task = &task;
+  this->count = count;
+  next = 0;
+  pending = count;
+  wake.notify_all();
+  while (runNext(lock)) {
+    // keep taking tasks until the batch is handed out
+  }
+  done.wait(lock, [this]{ return pending == 0; });
+  this->task = nullptr;
+}
+
+bool ThreadPool::runNext(std::unique_lock<std::mutex>& lock)
+{
+  if (!task || next >= count) {
+    return false;
+  }
+  int index = next++;
+  const std::function<void(int)>& fn = *task;
+  lock.unlock();
+  fn(index);
+  lock.lock();
+  if (--pending == 0) {
+    done.notify_all();
+  }
+  return true;
+}
+
+void ThreadPool::worker()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake.wait(lock, [this]{ return stopping || (task && next < count); });
+    if (stopping) {
+      return;
+    }
+    while (runNext(lock)) {
+      // keep taking tasks until the batch is handed out
+    }
+  }
+}
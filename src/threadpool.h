@@ -0,0 +1,45 @@
+#ifndef NW_THREADPOOL_H
+#define NW_THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run batches of indexed tasks. The calling
+// thread takes part in each batch, so a pool of size 1 has no worker threads
+// and runs everything inline.
+class ThreadPool
+{
+public:
+  ThreadPool(int threads = 1);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+
+  inline int size() const { return workers.size() + 1; }
+
+  // Calls task(i) for every i in [0, count) and returns when all of them have
+  // finished. Tasks may run in any order on any thread.
+  void run(int count, const std::function<void(int)>& task);
+
+  // Returns the number of hardware threads, or 1 if it can't be determined.
+  static int hardwareThreads();
+
+private:
+  void worker();
+  bool runNext(std::unique_lock<std::mutex>& lock);
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(int)>* task;
+  int count;
+  int next;
+  int pending;
+  bool stopping;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "trackfilter.h"
+#include <cmath>
+
+// M_PI and M_SQRT1_2 aren't part of standard C++, and MSVC only defines them
+// on request.
+static constexpr double PI = 3.14159265358979323846;
+static constexpr double BUTTERWORTH_Q = 0.70710678118654752440; // 1/sqrt(2)
+
+static BiquadCoefs rbjCoefs(int type, double freq, double q, double sampleRate)
+{
+  if (freq > sampleRate * 0.45) {
+    freq = sampleRate * 0.45;
+  }
+  double w0 = 2 * PI * freq / sampleRate;
+  double cosW = std::cos(w0);
+  double alpha = std::sin(w0) / (2 * q);
+  double b0, b1, b2;
+  if (type == TrackFilterTables::LPF) {
+    b0 = b2 = (1 - cosW) / 2;
+    b1 = 1 - cosW;
+  } else if (type == TrackFilterTables::HPF) {
+    b0 = b2 = (1 + cosW) / 2;
+    b1 = -(1 + cosW);
+  } else {
+    b0 = alpha;
+    b1 = 0;
+    b2 = -alpha;
+  }
+  double a0 = 1 + alpha;
+  BiquadCoefs coefs;
+  coefs.b0 = b0 / a0;
+  coefs.b1 = b1 / a0;
+  coefs.b2 = b2 / a0;
+  coefs.a1 = -2 * cosW / a0;
+  coefs.a2 = (1 - alpha) / a0;
+  return coefs;
+}
+
+TrackFilterTables::TrackFilterTables(double sampleRate)
+: biquads(NumTypes * 128), cutoffs(CUTOFF_NONE + 1)
+{
+  for (int type = LPF; type < NumTypes; type++) {
+    // Value 0 leaves the track unfiltered for every type.
+    for (int value = 1; value < 128; value++) {
+      double amount = value / 127.0;
+      BiquadCoefs& coefs = biquads[type * 128 + value];
+      if (type == LPF) {
+        coefs = rbjCoefs(LPF, 16000 * std::exp2(-7 * amount), BUTTERWORTH_Q, sampleRate);
+      } else if (type == HPF) {
+        coefs = rbjCoefs(HPF, 20 * std::exp2(9.6 * amount), BUTTERWORTH_Q, sampleRate);
+      } else {
+        // The band-pass types have a fixed center, and the value blends
+        // between the dry and filtered signal.
+        double center = 512 << (type - BPF512);
+        BiquadCoefs bpf = rbjCoefs(BPF512, center, 1.0, sampleRate);
+        coefs.b0 = (1 - amount) + amount * bpf.b0;
+        coefs.b1 = (1 - amount) * bpf.a1 + amount * bpf.b1;
+        coefs.b2 = (1 - amount) * bpf.a2 + amount * bpf.b2;
+        coefs.a1 = bpf.a1;
+        coefs.a2 = bpf.a2;
+      }
+    }
+  }
+  for (int value = 0; value < CUTOFF_NONE; value++) {
+    cutoffs[value] = rbjCoefs(LPF, 16000 * std::exp2((value - CUTOFF_NONE) / 8.0), BUTTERWORTH_Q, sampleRate);
+  }
+}
+
+const BiquadCoefs& TrackFilterTables::biquad(int type, int value) const
+{
+  if (type <= None || type >= NumTypes || value <= 0) {
+    return biquads[0];
+  }
+  return biquads[type * 128 + (value > 127 ? 127 : value)];
+}
+
+const BiquadCoefs& TrackFilterTables::cutoff(int value) const
+{
+  if (value < 0) {
+    value = 0;
+  } else if (value > CUTOFF_NONE) {
+    value = CUTOFF_NONE;
+  }
+  return cutoffs[value];
+}
+
+BiquadBank::BiquadBank(int lanes)
+: b0(lanes, 1.0f), b1(lanes), b2(lanes), a1(lanes), a2(lanes), z1(lanes), z2(lanes)
+{
+  // initializers only
+}
+
+void BiquadBank::setCoefs(int lane, const BiquadCoefs& coefs)
+{
+  b0[lane] = coefs.b0;
+  b1[lane] = coefs.b1;
+  b2[lane] = coefs.b2;
+  a1[lane] = coefs.a1;
+  a2[lane] = coefs.a2;
+}
+
+void BiquadBank::process(float* data, int frames)
+{
+  int lanes = b0.size();
+  const float* B0 = b0.data();
+  const float* B1 = b1.data();
+  const float* B2 = b2.data();
+  const float* A1 = a1.data();
+  const float* A2 = a2.data();
+  float* Z1 = z1.data();
+  float* Z2 = z2.data();
+  for (int f = 0; f < frames; f++, data += lanes) {
+    // Transposed direct form II. Each iteration is independent, so this loop
+    // vectorizes across lanes.
+    for (int i = 0; i < lanes; i++) {
+      float x = data[i];
+      float y = B0[i] * x + Z1[i];
+      Z1[i] = B1[i] * x - A1[i] * y + Z2[i];
+      Z2[i] = B2[i] * x - A2[i] * y;
+      data[i] = y;
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef NW_TRACKFILTER_H
+#define NW_TRACKFILTER_H
+
+#include <vector>
+
+struct BiquadCoefs
+{
+  float b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+};
+
+// Filter coefficients for every setting of the BiquadType/BiquadValue and
+// Cutoff commands, computed once for a sample rate.
+class TrackFilterTables
+{
+public:
+  enum BiquadType {
+    None = 0,
+    LPF = 1,
+    HPF = 2,
+    BPF512 = 3,
+    BPF1024 = 4,
+    BPF2048 = 5,
+    NumTypes
+  };
+
+  TrackFilterTables(double sampleRate);
+
+  const BiquadCoefs& biquad(int type, int value) const;
+  const BiquadCoefs& cutoff(int value) const;
+
+  // Cutoff values at or above this leave the track unfiltered.
+  static constexpr int CUTOFF_NONE = 64;
+
+private:
+  std::vector<BiquadCoefs> biquads;
+  std::vector<BiquadCoefs> cutoffs;
+};
+
+// A set of independent biquad filters stored as structures of arrays, so that
+// one pass over a block runs every lane side by side. Lanes are interleaved in
+// the data, one value per lane per frame.
+class BiquadBank
+{
+public:
+  BiquadBank(int lanes = 0);
+
+  inline int numLanes() const { return b0.size(); }
+
+  void setCoefs(int lane, const BiquadCoefs& coefs);
+  void process(float* data, int frames);
+
+private:
+  std::vector<float> b0, b1, b2, a1, a2;
+  std::vector<float> z1, z2;
+};
+
+#endif
@@ -0,0 +1,326 @@
+#include "trackmixer.h"
+#include "threadpool.h"
+#include "pcmsink.h"
+#include "resampler.h"
+#include "seq/isequence.h"
+#include "synth/synthcontext.h"
+#include "synth/iinterpolator.h"
+#include "seqtrack.h"
+#include "utility.h"
+#include <algorithm>
+#include <cmath>
+
+TrackMixer::TrackMixer(ClefContext* ctx, ISequence* seq, double sampleRate, ThreadPool* pool)
+: pool(pool), lockstep(false), rate(sampleRate), position(0), filterTables(sampleRate),
+  cutoffFilters(seq->numTracks() * 2), biquadFilters(seq->numTracks() * 2),
+  mainGains(seq->numTracks() * 2, 1.0f), processLanes(false), tailFrames(0)
+{
+  // Approximations of the default NW4R aux effects: a long reverb on A, a
+  // delay on B and a short slapback delay on C.
+  effects[0].reset(new ReverbEffect(sampleRate));
+  effects[1].reset(new DelayEffect(sampleRate, 0.25, 0.35));
+  effects[2].reset(new DelayEffect(sampleRate, 0.08, 0.2, 0.7));
+  for (int i = 0; i < NUM_AUX_BUSES; i++) {
+    sendGains[i].assign(seq->numTracks() * 2, 0.0f);
+    auxInput[i] = false;
+    auxRinging[i] = false;
+  }
+  int numTracks = seq->numTracks();
+  tracks.resize(numTracks);
+  for (int i = 0; i < numTracks; i++) {
+    Track& track = tracks[i];
+    track.synth.reset(new SynthContext(ctx, sampleRate, 2));
+    track.synth->interpolator = IInterpolator::get(IInterpolator::Linear);
+    track.synth->addChannel(seq->getTrack(i));
+    track.source = dynamic_cast<SEQTrack*>(seq->getTrack(i));
+    if (track.source) {
+      track.source->recordsBusEvents = true;
+    }
+    track.frames = 0;
+    track.finished = false;
+    track.biquadType = TrackFilterTables::None;
+    track.biquadValue = 0;
+    track.cutoff = TrackFilterTables::CUTOFF_NONE;
+  }
+}
+
+TrackMixer::~TrackMixer()
+{
+  // members clean up after themselves
+}
+
+void TrackMixer::setLockstep(bool lockstep)
+{
+  this->lockstep = lockstep;
+}
+
+void TrackMixer::renderTrack(Track& track, int offset, int frames)
+{
+  if (track.finished) {
+    return;
+  }
+  int bytes = track.synth->fillBuffer(reinterpret_cast<std::uint8_t*>(track.buffer.data() + offset * 2), frames * 4);
+  track.frames = offset + bytes / 4;
+  if (bytes / 4 < frames) {
+    track.finished = true;
+  }
+}
+
+int TrackMixer::render(std::int16_t* buffer, int frames)
+{
+  int numTracks = tracks.size();
+  for (Track& track : tracks) {
+    track.frames = 0;
+    if (!track.finished) {
+      track.buffer.resize(frames * 2);
+    }
+  }
+  if (lockstep) {
+    for (int offset = 0; offset < frames; offset += LOCKSTEP_FRAMES) {
+      int step = std::min(LOCKSTEP_FRAMES, frames - offset);
+      for (Track& track : tracks) {
+        renderTrack(track, offset, step);
+      }
+    }
+  } else if (pool) {
+    pool->run(numTracks, [this, frames](int i) { renderTrack(tracks[i], 0, frames); });
+  } else {
+    for (Track& track : tracks) {
+      renderTrack(track, 0, frames);
+    }
+  }
+
+  int rendered = 0;
+  for (const Track& track : tracks) {
+    if (track.frames > rendered) {
+      rendered = track.frames;
+    }
+  }
+  if (rendered == 0 && processLanes && tailFrames < MAX_TAIL * rate) {
+    // Let the aux effects ring out after the tracks have finished.
+    bool ringing = false;
+    for (bool bus : auxRinging) {
+      ringing = ringing || bus;
+    }
+    if (ringing) {
+      rendered = frames;
+      tailFrames += frames;
+    }
+  }
+
+  collectBusChanges(rendered);
+  if (processLanes || !busChanges.empty()) {
+    mixLanes(rendered);
+  } else {
+    // Integer sums in a fixed order keep the mix bit-identical no matter
+    // which thread rendered which track.
+    mix.assign(rendered * 2, 0);
+    for (const Track& track : tracks) {
+      const std::int16_t* samples = track.buffer.data();
+      int count = track.frames * 2;
+      for (int i = 0; i < count; i++) {
+        mix[i] += samples[i];
+      }
+    }
+  }
+  for (int i = 0; i < rendered * 2; i++) {
+    buffer[i] = clamp<std::int32_t>(mix[i], -0x8000, 0x7FFF);
+  }
+  position += rendered;
+  return rendered;
+}
+
+void TrackMixer::collectBusChanges(int frames)
+{
+  busChanges.clear();
+  int numTracks = tracks.size();
+  for (int i = 0; i < numTracks; i++) {
+    SEQTrack* source = tracks[i].source;
+    if (!source) {
+      continue;
+    }
+    // Events are recorded in time order. Any that belong to a later block
+    // stay queued on the track.
+    auto& events = source->busEvents;
+    std::size_t used = 0;
+    for (; used < events.size(); used++) {
+      std::int64_t frame = std::llround(events[used].timestamp * rate) - position;
+      if (frame >= frames) {
+        break;
+      }
+      busChanges.push_back({ frame < 0 ? 0 : int(frame), i, events[used].param, events[used].value });
+    }
+    events.erase(events.begin(), events.begin() + used);
+  }
+  std::stable_sort(busChanges.begin(), busChanges.end(), [](const BusChange& a, const BusChange& b) { return a.frame < b.frame; });
+}
+
+void TrackMixer::applyBusChange(const BusChange& change)
+{
+  Track& track = tracks[change.track];
+  switch (change.param) {
+  case SEQTrack::BusEvent::BiquadType:
+    track.biquadType = change.value;
+    break;
+  case SEQTrack::BusEvent::BiquadValue:
+    track.biquadValue = change.value;
+    break;
+  case SEQTrack::BusEvent::Cutoff:
+    track.cutoff = change.value;
+    break;
+  case SEQTrack::BusEvent::SendA:
+  case SEQTrack::BusEvent::SendB:
+  case SEQTrack::BusEvent::SendC:
+    for (int lane = change.track * 2; lane < change.track * 2 + 2; lane++) {
+      sendGains[change.param - SEQTrack::BusEvent::SendA][lane] = clamp(change.value, 0, 127) / 127.0f;
+    }
+    return;
+  case SEQTrack::BusEvent::MainSend:
+    for (int lane = change.track * 2; lane < change.track * 2 + 2; lane++) {
+      mainGains[lane] = clamp(change.value, 0, 127) / 127.0f;
+    }
+    return;
+  }
+  const BiquadCoefs& cutoff = filterTables.cutoff(track.cutoff);
+  const BiquadCoefs& biquad = filterTables.biquad(track.biquadType, track.biquadValue);
+  for (int lane = change.track * 2; lane < change.track * 2 + 2; lane++) {
+    cutoffFilters.setCoefs(lane, cutoff);
+    biquadFilters.setCoefs(lane, biquad);
+  }
+}
+
+void TrackMixer::mixLanes(int frames)
+{
+  // Transpose the tracks into one lane per track channel so that a single
+  // pass filters all of them. Unfiltered lanes pass through unchanged.
+  int numLanes = tracks.size() * 2;
+  lanes.assign(frames * numLanes, 0.0f);
+  for (int lane = 0; lane < numLanes; lane++) {
+    const Track& track = tracks[lane / 2];
+    const std::int16_t* samples = track.buffer.data() + (lane & 1);
+    for (int i = 0; i < track.frames; i++) {
+      lanes[i * numLanes + lane] = samples[i * 2];
+    }
+  }
+
+  mix.assign(frames * 2, 0);
+  for (int bus = 0; bus < NUM_AUX_BUSES; bus++) {
+    auxBuses[bus].assign(frames * 2, 0.0f);
+    auxInput[bus] = false;
+  }
+
+  int pos = 0;
+  for (const BusChange& change : busChanges) {
+    if (change.frame > pos) {
+      mixSegment(pos, change.frame);
+      pos = change.frame;
+    }
+    applyBusChange(change);
+  }
+  if (frames > pos) {
+    mixSegment(pos, frames);
+  }
+  mixAuxBuses(frames);
+  processLanes = needsLanes();
+}
+
+void TrackMixer::mixSegment(int from, int to)
+{
+  int numLanes = tracks.size() * 2;
+  float* data = &lanes[from * numLanes];
+  cutoffFilters.process(data, to - from);
+  biquadFilters.process(data, to - from);
+
+  const float* gains = mainGains.data();
+  for (int i = from; i < to; i++) {
+    const float* frame = &lanes[i * numLanes];
+    for (int lane = 0; lane < numLanes; lane++) {
+      mix[i * 2 + (lane & 1)] += std::lround(frame[lane] * gains[lane]);
+    }
+  }
+
+  for (int bus = 0; bus < NUM_AUX_BUSES; bus++) {
+    const float* sends = sendGains[bus].data();
+    if (std::none_of(sends, sends + numLanes, [](float g) { return g > 0; })) {
+      continue;
+    }
+    auxInput[bus] = true;
+    float* aux = auxBuses[bus].data();
+    for (int i = from; i < to; i++) {
+      const float* frame = &lanes[i * numLanes];
+      for (int lane = 0; lane < numLanes; lane++) {
+        aux[i * 2 + (lane & 1)] += frame[lane] * sends[lane];
+      }
+    }
+  }
+}
+
+void TrackMixer::mixAuxBuses(int frames)
+{
+  for (int bus = 0; bus < NUM_AUX_BUSES; bus++) {
+    if (!auxInput[bus] && !auxRinging[bus]) {
+      continue;
+    }
+    float* aux = auxBuses[bus].data();
+    effects[bus]->process(aux, frames);
+    float peak = 0;
+    for (int i = 0; i < frames * 2; i++) {
+      mix[i] += std::lround(aux[i]);
+      peak = std::max(peak, std::fabs(aux[i]));
+    }
+    // Keep running the effect with no input until its output rounds to
+    // silence.
+    auxRinging[bus] = auxInput[bus] || peak >= 0.5f;
+  }
+}
+
+bool TrackMixer::needsLanes() const
+{
+  for (const Track& track : tracks) {
+    if ((track.biquadType != TrackFilterTables::None && track.biquadValue > 0) || track.cutoff < TrackFilterTables::CUTOFF_NONE) {
+      return true;
+    }
+  }
+  for (float gain : mainGains) {
+    if (gain != 1.0f) {
+      return true;
+    }
+  }
+  for (int bus = 0; bus < NUM_AUX_BUSES; bus++) {
+    if (auxRinging[bus]) {
+      return true;
+    }
+    for (float gain : sendGains[bus]) {
+      if (gain > 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void TrackMixer::save(PcmSink* sink, Resampler* resampler)
+{
+  std::vector<std::int16_t> block(BLOCK_FRAMES * 2);
+  std::vector<std::int16_t> resampled;
+  while (true) {
+    int frames = render(block.data(), BLOCK_FRAMES);
+    if (frames <= 0) {
+      break;
+    }
+    if (resampler) {
+      resampled.clear();
+      resampler->process(block.data(), frames, resampled);
+      sink->write(resampled);
+    } else {
+      block.resize(frames * 2);
+      sink->write(block);
+      block.resize(BLOCK_FRAMES * 2);
+    }
+  }
+  if (resampler) {
+    resampled.clear();
+    resampler->flush(resampled);
+    sink->write(resampled);
+  }
+}
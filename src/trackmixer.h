@@ -0,0 +1,106 @@
+#ifndef NW_TRACKMIXER_H
+#define NW_TRACKMIXER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "trackfilter.h"
+#include "auxeffect.h"
+class ClefContext;
+class SynthContext;
+class ISequence;
+class SEQTrack;
+class ThreadPool;
+class PcmSink;
+class Resampler;
+
+// Renders each track of a sequence with its own SynthContext so that tracks
+// can be synthesized on separate threads. Tracks are rendered a block at a
+// time into their own buffers and summed in track order, so the output does
+// not depend on the number of threads.
+//
+// Track-level filters (BiquadType/BiquadValue and Cutoff) are applied here to
+// each track's block before mixing, with every filtered track processed in
+// the same pass. Tracks then feed the main mix and the shared aux buses
+// according to their MainSend and SendA/B/C levels, and each bus runs its
+// effect once per block.
+class TrackMixer
+{
+public:
+  TrackMixer(ClefContext* ctx, ISequence* seq, double sampleRate, ThreadPool* pool = nullptr);
+  ~TrackMixer();
+
+  static constexpr int BLOCK_FRAMES = 4096;
+  static constexpr int NUM_AUX_BUSES = 3;
+  // Longest effect tail rendered after the tracks have finished.
+  static constexpr double MAX_TAIL = 10.0;
+
+  // Renders the tracks in turn, a few frames at a time, on the calling
+  // thread instead of a block each on the pool. Tracks that share a voice
+  // limit need this so that the limit sees notes start and end in time
+  // order, to within LOCKSTEP_FRAMES.
+  void setLockstep(bool lockstep);
+  static constexpr int LOCKSTEP_FRAMES = 64;
+
+  // Renders up to the specified number of stereo frames into buffer and
+  // returns the number of frames rendered. Returns 0 once every track has
+  // finished.
+  int render(std::int16_t* buffer, int frames);
+
+  // Renders the whole sequence to the sink, converting it to another
+  // sample rate first if a resampler is provided.
+  void save(PcmSink* sink, Resampler* resampler = nullptr);
+
+  inline double sampleRate() const { return rate; }
+  inline int numTracks() const { return tracks.size(); }
+
+private:
+  struct Track {
+    std::unique_ptr<SynthContext> synth;
+    SEQTrack* source;
+    std::vector<std::int16_t> buffer;
+    int frames;
+    bool finished;
+    int biquadType;
+    int biquadValue;
+    int cutoff;
+  };
+
+  struct BusChange {
+    int frame;
+    int track;
+    int param;
+    int value;
+  };
+
+  void renderTrack(Track& track, int offset, int frames);
+  void collectBusChanges(int frames);
+  void applyBusChange(const BusChange& change);
+  void mixLanes(int frames);
+  void mixSegment(int from, int to);
+  void mixAuxBuses(int frames);
+  bool needsLanes() const;
+
+  std::vector<Track> tracks;
+  std::vector<std::int32_t> mix;
+  ThreadPool* pool;
+  bool lockstep;
+  double rate;
+  std::int64_t position;
+
+  TrackFilterTables filterTables;
+  BiquadBank cutoffFilters;
+  BiquadBank biquadFilters;
+  std::vector<BusChange> busChanges;
+  std::vector<float> lanes;
+  std::vector<float> mainGains;
+  std::vector<float> sendGains[NUM_AUX_BUSES];
+  std::unique_ptr<AuxEffect> effects[NUM_AUX_BUSES];
+  std::vector<float> auxBuses[NUM_AUX_BUSES];
+  bool auxInput[NUM_AUX_BUSES];
+  bool auxRinging[NUM_AUX_BUSES];
+  bool processLanes;
+  std::int64_t tailFrames;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include "voicecontrol.h"
+#include "modulation.h"
+#include "panlaw.h"
+#include "utility.h"
+#include <cmath>
+
+VoiceControl::VoiceControl(double rateRatio, const PanLaw* panLaw, int panOffset)
+: rateRatio(rateRatio), increment(0), gain(1), panLeft(1), panRight(1), panLaw(panLaw), panOffset(panOffset), lastPan(-1)
+{
+  // initializers only
+}
+
+void VoiceControl::update(double pitch, double volume, double pan, const Modulation* modulation, double time)
+{
+  increment = pitch * rateRatio;
+  gain = volume;
+  if (modulation) {
+    double pitchMod, volumeMod, panMod;
+    modulation->evaluate(time, &pitchMod, &volumeMod, &panMod);
+    if (pitchMod != 0) {
+      increment *= semitonesToFactor(pitchMod);
+    }
+    if (volumeMod != 0) {
+      gain *= std::pow(10.0, volumeMod / 20.0);
+    }
+    pan = clamp(pan + panMod, 0.0, 1.0);
+  }
+  if (pan != lastPan) {
+    lastPan = pan;
+    if (panLaw) {
+      int position = clamp<int>(std::lround(pan * 128) + panOffset, 0, PanLaw::NUM_POSITIONS - 1);
+      panLeft = panLaw->left(position);
+      panRight = panLaw->right(position);
+    } else {
+      panLeft = pan <= 0.5 ? 1.0 : 2.0 * (1.0 - pan);
+      panRight = pan >= 0.5 ? 1.0 : 2.0 * pan;
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef NW_VOICECONTROL_H
+#define NW_VOICECONTROL_H
+
+#include <cstdint>
+struct Modulation;
+class PanLaw;
+
+// The per-voice work shared by NWVoice and NWPlayer, so that a note sounds
+// the same through the offline renderer and the real-time player.
+
+// Playback rate, gain and channel gains of a voice, updated once per control
+// period from the note's parameters and modulation.
+struct VoiceControl
+{
+  VoiceControl(double rateRatio = 1, const PanLaw* panLaw = nullptr, int panOffset = 0);
+
+  // pitch is the combined pitch and pitch bend factor, volume is the note's
+  // velocity gain and pan is 0 (left) to 1 (right). modulation may be null.
+  void update(double pitch, double volume, double pan, const Modulation* modulation, double time);
+
+  double rateRatio;
+  double increment;
+  double gain;
+  double panLeft, panRight;
+  const PanLaw* panLaw;
+  int panOffset;
+  double lastPan;
+};
+
+// Wraps position around the loop of the wave and moves the reader to it.
+// Returns false once position has passed the end of an unlooped wave.
+template <typename Reader>
+inline bool seekVoiceFrame(Reader& reader, double& position)
+{
+  if (reader.loopStart >= 0 && position >= reader.loopEnd) {
+    position -= reader.loopEnd - reader.loopStart;
+  }
+  std::uint32_t index = std::uint32_t(position);
+  if (index >= reader.loopEnd) {
+    return false;
+  }
+  reader.seek(index);
+  return true;
+}
+
+// Reads the interpolated frame at position, after seekVoiceFrame(), as a
+// stereo pair.
+template <typename Reader>
+inline void readVoiceFrame(const Reader& reader, double position, double* out)
+{
+  reader.read(position - std::uint32_t(position), out);
+  if (reader.numChannels < 2) {
+    out[1] = out[0];
+  }
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include "voicepool.h"
+#include "discreteenvelope.h"
+
+VoicePool::VoicePool(int maxVoices)
+: stolen(0), dropped(0), nextSerial(0)
+{
+  setMaxVoices(maxVoices);
+}
+
+VoicePool::~VoicePool()
+{
+  setMaxVoices(0);
+}
+
+void VoicePool::setMaxVoices(int maxVoices)
+{
+  for (Slot& slot : slots) {
+    if (slot.voice) {
+      slot.voice->detachPool();
+    }
+  }
+  slots.assign(maxVoices > 0 ? maxVoices : 0, Slot{ nullptr, 0, 0 });
+}
+
+bool VoicePool::stealsBefore(const Rank& a, const Rank& b)
+{
+  if (a.priority != b.priority) {
+    return a.priority < b.priority;
+  }
+  if (a.releasing != b.releasing) {
+    return a.releasing;
+  }
+  return a.level < b.level || (a.level == b.level && a.serial < b.serial);
+}
+
+VoicePool::Rank VoicePool::rank(const Slot& slot)
+{
+  return Rank{ slot.priority, slot.voice->isReleasing(), slot.voice->level(), slot.serial };
+}
+
+int VoicePool::acquire(int priority)
+{
+  int numSlots = slots.size();
+  int victim = -1;
+  for (int i = 0; i < numSlots; i++) {
+    Slot& slot = slots[i];
+    if (!slot.voice || !slot.voice->isActive()) {
+      if (slot.voice) {
+        slot.voice->detachPool();
+        slot.voice = nullptr;
+      }
+      slot.priority = priority;
+      return i;
+    }
+    if (slot.priority > priority) {
+      continue;
+    }
+    if (victim < 0 || stealsBefore(rank(slot), rank(slots[victim]))) {
+      victim = i;
+    }
+  }
+  if (victim < 0) {
+    ++dropped;
+    return -1;
+  }
+  slots[victim].voice->kill();
+  slots[victim].voice->detachPool();
+  slots[victim].voice = nullptr;
+  ++stolen;
+  slots[victim].priority = priority;
+  return victim;
+}
+
+void VoicePool::assign(int slot, DiscreteEnvelope* voice)
+{
+  if (slot < 0 || slot >= slots.size()) {
+    return;
+  }
+  if (slots[slot].voice) {
+    slots[slot].voice->detachPool();
+  }
+  slots[slot].voice = voice;
+  slots[slot].serial = nextSerial++;
+  voice->attachPool(this);
+}
+
+void VoicePool::release(DiscreteEnvelope* voice)
+{
+  for (Slot& slot : slots) {
+    if (slot.voice == voice) {
+      slot.voice = nullptr;
+      return;
+    }
+  }
+}
+
+int VoicePool::activeVoices() const
+{
+  int count = 0;
+  for (const Slot& slot : slots) {
+    if (slot.voice && slot.voice->isActive()) {
+      ++count;
+    }
+  }
+  return count;
+}
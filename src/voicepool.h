@@ -0,0 +1,60 @@
+#ifndef NW_VOICEPOOL_H
+#define NW_VOICEPOOL_H
+
+#include <cstdint>
+#include <vector>
+class DiscreteEnvelope;
+
+// Limits the number of simultaneously sounding voices. When the pool is full,
+// a new note steals the voice with the lowest priority, preferring voices that
+// are releasing or quiet, like the channel allocator on the original hardware.
+class VoicePool
+{
+public:
+  VoicePool(int maxVoices = 0);
+  ~VoicePool();
+  VoicePool(const VoicePool& other) = delete;
+  VoicePool& operator=(const VoicePool& other) = delete;
+
+  void setMaxVoices(int maxVoices);
+  inline int maxVoices() const { return slots.size(); }
+  inline bool isLimited() const { return !slots.empty(); }
+
+  // Returns a slot for a new voice of the given priority, or -1 if every
+  // sounding voice outranks it.
+  int acquire(int priority);
+  void assign(int slot, DiscreteEnvelope* voice);
+  void release(DiscreteEnvelope* voice);
+
+  int activeVoices() const;
+
+  // What the stealing order looks at in a sounding voice.
+  struct Rank {
+    int priority;
+    bool releasing;
+    double level;
+    std::uint64_t serial;
+  };
+
+  // Returns true if a should be stolen before b: the lowest priority first,
+  // then releasing voices, then the quietest, then the oldest. Shared with
+  // NWPlayer, which keeps its own voice table.
+  static bool stealsBefore(const Rank& a, const Rank& b);
+
+  std::uint64_t stolen;
+  std::uint64_t dropped;
+
+private:
+  struct Slot {
+    DiscreteEnvelope* voice;
+    int priority;
+    std::uint64_t serial;
+  };
+
+  static Rank rank(const Slot& slot);
+
+  std::vector<Slot> slots;
+  std::uint64_t nextSerial;
+};
+
+#endif
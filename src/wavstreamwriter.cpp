@@ -0,0 +1,114 @@
+#include "wavstreamwriter.h"
+
+// The RIFF size field is 32 bits, so longer output is cut off there.
+static constexpr std::uint64_t MAX_DATA_BYTES = 0xFFFFFFFFull - 36;
+static constexpr std::uint32_t UNKNOWN_SIZE = 0xFFFFFFFF;
+
+static void putU16(std::uint8_t* out, std::uint16_t value)
+{
+  out[0] = value;
+  out[1] = value >> 8;
+}
+
+static void putU32(std::uint8_t* out, std::uint32_t value)
+{
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+  out[3] = value >> 24;
+}
+
+WavStreamWriter::WavStreamWriter(std::uint32_t sampleRate, int channels)
+: file(nullptr), sampleRate(sampleRate), channels(channels), seekable(false), ownsFile(false), error(false), bytes(0)
+{
+  // initializers only
+}
+
+WavStreamWriter::~WavStreamWriter()
+{
+  close();
+}
+
+bool WavStreamWriter::open(const std::string& filename)
+{
+  close();
+#ifndef _WIN32
+  if (filename == "/dev/stdout") {
+    file = stdout;
+  }
+#endif
+  if (!file) {
+    file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    ownsFile = true;
+  }
+  seekable = std::fseek(file, 0, SEEK_CUR) == 0 && std::ftell(file) == 0;
+  bytes = 0;
+  error = !writeHeader(seekable ? 0 : UNKNOWN_SIZE);
+  // Let a reader on the other end of a pipe start right away.
+  if (!seekable && std::fflush(file) != 0) {
+    error = true;
+  }
+  return true;
+}
+
+bool WavStreamWriter::writeHeader(std::uint32_t dataSize)
+{
+  std::uint8_t header[44];
+  std::uint32_t riffSize = dataSize == UNKNOWN_SIZE ? UNKNOWN_SIZE : dataSize + 36;
+  putU32(header, 0x46464952);      // "RIFF"
+  putU32(header + 4, riffSize);
+  putU32(header + 8, 0x45564157);  // "WAVE"
+  putU32(header + 12, 0x20746d66); // "fmt "
+  putU32(header + 16, 16);
+  putU16(header + 20, 1);          // PCM
+  putU16(header + 22, channels);
+  putU32(header + 24, sampleRate);
+  putU32(header + 28, sampleRate * channels * 2);
+  putU16(header + 32, channels * 2);
+  putU16(header + 34, 16);
+  putU32(header + 36, 0x61746164); // "data"
+  putU32(header + 40, dataSize);
+  return std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool WavStreamWriter::write(const std::int16_t* samples, std::size_t count)
+{
+  if (!file || error) {
+    return false;
+  }
+  if (!count) {
+    return true;
+  }
+  if (bytes + count * 2 > MAX_DATA_BYTES) {
+    count = (MAX_DATA_BYTES - bytes) / 2;
+  }
+  buffer.resize(count * 2);
+  for (std::size_t i = 0; i < count; i++) {
+    putU16(&buffer[i * 2], samples[i]);
+  }
+  std::size_t written = std::fwrite(buffer.data(), 1, buffer.size(), file);
+  bytes += written;
+  if (written < buffer.size() || (!seekable && std::fflush(file) != 0)) {
+    error = true;
+  }
+  return !error;
+}
+
+bool WavStreamWriter::close()
+{
+  if (!file) {
+    return !error;
+  }
+  if (seekable && (std::fseek(file, 0, SEEK_SET) != 0 || !writeHeader(bytes))) {
+    error = true;
+  }
+  if (ownsFile ? std::fclose(file) != 0 : std::fflush(file) != 0) {
+    error = true;
+  }
+  file = nullptr;
+  ownsFile = false;
+  return !error;
+}
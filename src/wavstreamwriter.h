@@ -0,0 +1,54 @@
+#ifndef NW_WAVSTREAMWRITER_H
+#define NW_WAVSTREAMWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Writes a 16-bit PCM WAV file as the samples arrive. The header goes out
+// first, before the length is known; if the file is seekable its sizes are
+// filled in by close(), and otherwise (a pipe, for instance) they are left at
+// the maximum, which readers treat as "until the end of the stream". Nothing
+// is held back beyond the current block.
+//
+// A short write, such as on a full disk, is an error. Once one has happened,
+// nothing more is written and close() reports it.
+class WavStreamWriter
+{
+public:
+  WavStreamWriter(std::uint32_t sampleRate, int channels = 2);
+  ~WavStreamWriter();
+  WavStreamWriter(const WavStreamWriter& other) = delete;
+  WavStreamWriter& operator=(const WavStreamWriter& other) = delete;
+
+  bool open(const std::string& filename);
+
+  // Returns false if the samples could not all be written.
+  bool write(const std::int16_t* samples, std::size_t count);
+  inline bool write(const std::vector<std::int16_t>& samples) { return write(samples.data(), samples.size()); }
+
+  // Patches the header if possible and closes the file. Returns false if
+  // anything written to the file since open() failed. Called by the
+  // destructor if needed.
+  bool close();
+
+  inline bool isOpen() const { return file; }
+  inline bool hasError() const { return error; }
+  inline bool isSeekable() const { return seekable; }
+  inline std::uint64_t dataBytes() const { return bytes; }
+
+private:
+  bool writeHeader(std::uint32_t dataSize);
+
+  std::FILE* file;
+  std::uint32_t sampleRate;
+  int channels;
+  bool seekable;
+  bool ownsFile;
+  bool error;
+  std::uint64_t bytes;
+  std::vector<std::uint8_t> buffer;
+};
+
+#endif
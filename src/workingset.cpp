@@ -0,0 +1,50 @@
+#include "workingset.h"
+#include "threadpool.h"
+#include "rvl/rseqfile.h"
+#include "rvl/rwarfile.h"
+#include "seq/isequence.h"
+#include "seq/itrack.h"
+
+WorkingSet WorkingSet::scan(RSEQFile* seq)
+{
+  WorkingSet set;
+  seq->setWorkingSet(&set);
+  ISequence* sequence = seq->sequence();
+  int numTracks = sequence->numTracks();
+  for (int i = 0; i < numTracks; i++) {
+    ITrack* track = sequence->getTrack(i);
+    while (track->nextEvent()) {
+      // notes are recorded by the instrument and returned as placeholders
+    }
+  }
+  seq->setWorkingSet(nullptr);
+  return set;
+}
+
+void WorkingSet::add(int program, int region, int wave)
+{
+  regions.insert(Entry{ program, region, wave });
+  if (waveSet.insert(wave).second) {
+    waveList.push_back(wave);
+  }
+}
+
+void WorkingSet::prefetch(const RWARFile* war, ThreadPool* pool) const
+{
+  std::vector<int> decode;
+  for (int wave : waveList) {
+    if (!war->playsDirect(wave)) {
+      decode.push_back(wave);
+    }
+  }
+  auto load = [&](int i) {
+    war->getSample(decode[i]);
+  };
+  if (pool) {
+    pool->run(decode.size(), load);
+  } else {
+    for (int i = 0; i < decode.size(); i++) {
+      load(i);
+    }
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef NW_WORKINGSET_H
+#define NW_WORKINGSET_H
+
+#include <set>
+#include <vector>
+#include "seq/sequenceevent.h"
+class RSEQFile;
+class RWARFile;
+class ThreadPool;
+
+// Stands in for a note while a sequence is being scanned. The track reader
+// only moves its clock forward on events, so a scan that returned nothing
+// for notes would never reach the end of a loop made only of notes.
+struct WorkingSetEvent : public SequenceEvent
+{
+};
+
+// The bank regions and waves that a sequence plays, found by reading through
+// the sequence without rendering it. Program changes, transposition and ties
+// are followed exactly as in playback, so the waves can be decoded before the
+// first sample is rendered, and only those waves.
+class WorkingSet
+{
+public:
+  struct Entry {
+    int program;
+    int region;
+    int wave;
+
+    inline bool operator<(const Entry& other) const {
+      return program != other.program ? program < other.program : region < other.region;
+    }
+  };
+
+  // Reads every track of the sequence to the end. The sequence must have its
+  // bank loaded, and can't be played afterwards.
+  static WorkingSet scan(RSEQFile* seq);
+
+  void add(int program, int region, int wave);
+
+  inline const std::set<Entry>& entries() const { return regions; }
+  inline const std::vector<int>& waves() const { return waveList; }
+
+  // Decodes every wave in the set that the archive doesn't play directly,
+  // spread over the pool if one is given. Decoded samples are kept by the
+  // archive's sample cache.
+  void prefetch(const RWARFile* war, ThreadPool* pool = nullptr) const;
+
+private:
+  std::set<Entry> regions;
+  std::set<int> waveSet;
+  std::vector<int> waveList;
+};
+
+#endif